@@ -0,0 +1,509 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      This file is the implementation code for the archives (see
+ *      archive_huff.h for the layout).  An entry is a stream made by
+ *      compress_buffer() and read back by decompress_buffer(), this only
+ *      moves the files through the workers and keeps the directory.
+ *
+ ***************************/
+
+#include <stdlib.h>    // malloc(), calloc(), realloc(), free()
+#include <string.h>    // strlen(), strcmp(), memcpy()
+#include <fcntl.h>     // open()
+#include <unistd.h>    // close(), lseek()
+#include <sys/stat.h>  // fstat()
+
+#include "huff.h"
+#include "archive_huff.h"
+#include "block_huff.h"
+#include "pool_huff.h"
+#include "stats_huff.h"
+
+// one entry on its way through a worker
+struct entry_slot {
+   struct job job;
+   const char *name;                    // file to compress
+   const struct archive_entry *entry;   // or entry to check
+   int fd;                              // the archive the entry is in
+   unsigned char *in;
+   unsigned long in_cap;
+   unsigned char *out;
+   unsigned long out_cap;
+   unsigned long raw_len;
+   unsigned long size;
+   unsigned long block_size;
+   int streams;
+   int split;
+   int context;
+   int checksum;
+   int sample;
+   struct decode_table table;           // kept from entry to entry
+   int ret;
+};
+
+// function prototypes
+static void put_number(unsigned char *p, unsigned long num);
+static unsigned long get_number(const unsigned char *p);
+static void put_number64(unsigned char *p, unsigned long long num);
+static unsigned long long get_number64(const unsigned char *p);
+static int  grow_buffer(unsigned char **buf, unsigned long *cap, unsigned long need);
+static long read_at(int fd, unsigned char *buf, unsigned long len, unsigned long long offset);
+static int  read_file(const char *name, unsigned char **buf, unsigned long *cap, unsigned long *len);
+static int  decode_entry(int fd, const struct archive_entry *entry, unsigned char **in, unsigned long *in_cap,
+      unsigned char **out, unsigned long *out_cap, struct decode_table *table);
+static void compress_entry(void *arg);
+static void check_entry(void *arg);
+
+int compress_archive(FILE *file_out, char *names[], unsigned long num, unsigned long block_size, int threads,
+      int streams, int split, int context, int checksum, int sample, unsigned long *failed) {
+
+   // variable declarations
+   unsigned char header[5] = {0x4C, 0x70, 0xF0, ARCHIVE_MAGIC, 0x00}, record[ARCHIVE_RECORD], footer[ARCHIVE_FOOTER];
+   struct entry_slot *slots = NULL, *slot = NULL;
+   struct archive_entry *entries = NULL;
+   struct pool *pool = NULL;
+   unsigned long long offset = sizeof(header);
+   unsigned long queued = 0, written = 0, i = 0, len = 0;
+   int num_slots = 0, ret = HUFF_OK;
+
+   if (num > 0xFFFFFFFFul) {
+      return HUFF_ERR_ARGUMENT;
+   }
+
+   // two entries per worker in flight, as with the blocks of a stream
+   if (threads > MAX_THREADS) {
+      threads = MAX_THREADS;
+   }
+   num_slots = (threads > 1) ? 2 * threads : 1;
+   slots = (struct entry_slot *)calloc(num_slots, sizeof(struct entry_slot));
+   entries = (struct archive_entry *)malloc((num + 1) * sizeof(struct archive_entry));
+   if (slots == NULL || entries == NULL) {
+      free(slots);
+      free(entries);
+      return HUFF_ERR_MEMORY;
+   }
+   if (threads > 1) {
+      pool = create_pool(threads);
+   }
+
+   if (stats_fwrite(header, sizeof(header), file_out) != sizeof(header)) {
+      ret = HUFF_ERR_WRITE;
+   }
+
+   while (ret == HUFF_OK) {
+      // hand out files while there are any and a free slot
+      while (ret == HUFF_OK && queued < num && queued - written < num_slots) {
+         if (strlen(names[queued]) > MAX_ENTRY_NAME) {
+            *failed = queued;
+            ret = HUFF_ERR_ARGUMENT;
+            break;
+         }
+         slot = &slots[queued % num_slots];
+         slot->name = names[queued];
+         slot->block_size = block_size;
+         slot->streams = streams;
+         slot->split = split;
+         slot->context = context;
+         slot->checksum = checksum;
+         slot->sample = sample;
+         submit_job(pool, &slot->job, compress_entry, slot);
+         queued++;
+      }
+
+      if (written == queued) {
+         break;
+      }
+
+      // the entries are written out in order
+      slot = &slots[written % num_slots];
+      wait_job(pool, &slot->job);
+      if (slot->ret != HUFF_OK) {
+         *failed = written;
+         ret = slot->ret;
+      } else if (stats_fwrite(slot->out, slot->size, file_out) != slot->size) {
+         ret = HUFF_ERR_WRITE;
+      } else {
+         entries[written].offset = offset;
+         entries[written].size = slot->size;
+         entries[written].raw_len = slot->raw_len;
+         entries[written].name = names[written];
+         offset += slot->size;
+      }
+      written++;
+   }
+
+   // the workers finish whatever is still queued before the buffers go away
+   destroy_pool(pool);
+
+   // the directory and the footer pointing back to it
+   for (i = 0; i < num && ret == HUFF_OK; i++) {
+      len = strlen(entries[i].name);
+      put_number64(record, entries[i].offset);
+      put_number64(record + 8, entries[i].size);
+      put_number64(record + 16, entries[i].raw_len);
+      record[24] = (unsigned char)(len >> 8);
+      record[25] = (unsigned char)len;
+      if (stats_fwrite(record, ARCHIVE_RECORD, file_out) != ARCHIVE_RECORD ||
+            stats_fwrite(entries[i].name, len, file_out) != len) {
+         ret = HUFF_ERR_WRITE;
+      }
+   }
+   if (ret == HUFF_OK) {
+      put_number64(footer, offset);
+      put_number(footer + 8, num);
+      footer[12] = 0x4C;
+      footer[13] = 0x70;
+      footer[14] = 0xF0;
+      footer[15] = FOOTER_MAGIC;
+      if (stats_fwrite(footer, ARCHIVE_FOOTER, file_out) != ARCHIVE_FOOTER) {
+         ret = HUFF_ERR_WRITE;
+      }
+   }
+
+   for (i = 0; i < (unsigned long)num_slots; i++) {
+      free(slots[i].in);
+      free(slots[i].out);
+   }
+   free(slots);
+   free(entries);
+
+   return ret;
+}
+
+int read_directory(int fd, struct archive_dir *dir) {
+   // variable declarations
+   unsigned char footer[ARCHIVE_FOOTER], *records = NULL, *p = NULL, *end = NULL;
+   unsigned long long start = 0, size = 0;
+   unsigned long i = 0, len = 0;
+   long long file_len = 0;
+   char *name = NULL;
+   int ret = HUFF_OK;
+
+   dir->entries = NULL;
+   dir->count = 0;
+   dir->names = NULL;
+
+   // the footer at the very end points back to the directory, so the
+   // archive must be a file that can be seeked in
+   if ((file_len = lseek(fd, 0, SEEK_END)) < 0) {
+      return HUFF_ERR_READ;
+   }
+   if (file_len < (long long)(sizeof(footer) + 5)) {
+      return HUFF_ERR_CORRUPT;
+   }
+   if (read_at(fd, footer, ARCHIVE_FOOTER, file_len - ARCHIVE_FOOTER) != ARCHIVE_FOOTER ||
+         footer[12] != 0x4C || footer[13] != 0x70 || footer[14] != 0xF0 || footer[15] != FOOTER_MAGIC) {
+      return HUFF_ERR_CORRUPT;
+   }
+   start = get_number64(footer);
+   if (start < 5 || start > (unsigned long long)file_len - ARCHIVE_FOOTER) {
+      return HUFF_ERR_CORRUPT;
+   }
+   size = file_len - ARCHIVE_FOOTER - start;
+   if (get_number(footer + 8) > size / ARCHIVE_RECORD) {
+      return HUFF_ERR_CORRUPT;
+   }
+
+   // the names take no more room than the records, zeros included
+   records = (unsigned char *)malloc(size + 1);
+   dir->names = (char *)malloc(size + 1);
+   dir->entries = (struct archive_entry *)malloc((get_number(footer + 8) + 1) * sizeof(struct archive_entry));
+   if (records == NULL || dir->names == NULL || dir->entries == NULL) {
+      ret = HUFF_ERR_MEMORY;
+   } else if (read_at(fd, records, size, start) != (long)size) {
+      ret = HUFF_ERR_CORRUPT;
+   }
+
+   // every entry's stream must lie between the header and the directory
+   p = records;
+   end = records + size;
+   name = dir->names;
+   for (i = 0; i < get_number(footer + 8) && ret == HUFF_OK; i++) {
+      if (end - p < ARCHIVE_RECORD) {
+         ret = HUFF_ERR_CORRUPT;
+         break;
+      }
+      dir->entries[i].offset = get_number64(p);
+      dir->entries[i].size = get_number64(p + 8);
+      dir->entries[i].raw_len = get_number64(p + 16);
+      len = ((unsigned long)p[24] << 8) | p[25];
+      p += ARCHIVE_RECORD;
+      if ((unsigned long)(end - p) < len || dir->entries[i].offset < 5 || dir->entries[i].size > start ||
+            dir->entries[i].offset > start - dir->entries[i].size) {
+         ret = HUFF_ERR_CORRUPT;
+         break;
+      }
+      memcpy(name, p, len);
+      name[len] = '\0';
+      dir->entries[i].name = name;
+      name += len + 1;
+      p += len;
+      dir->count++;
+   }
+   if (ret == HUFF_OK && p != end) {
+      ret = HUFF_ERR_CORRUPT;
+   }
+
+   free(records);
+   if (ret != HUFF_OK) {
+      free_directory(dir);
+   }
+
+   return ret;
+}
+
+long find_entry(const struct archive_dir *dir, const char *name) {
+   // variable declarations
+   unsigned long i = 0;
+
+   for (i = 0; i < dir->count; i++) {
+      if (strcmp(dir->entries[i].name, name) == 0) {
+         return i;
+      }
+   }
+
+   return -1;
+}
+
+int extract_entry(int fd, const struct archive_entry *entry, FILE *file_out, struct decode_table *table) {
+   // variable declarations
+   unsigned char *in = NULL, *out = NULL;
+   unsigned long in_cap = 0, out_cap = 0;
+   int ret = HUFF_OK;
+
+   ret = decode_entry(fd, entry, &in, &in_cap, &out, &out_cap, table);
+   if (ret == HUFF_OK && file_out != NULL && stats_fwrite(out, entry->raw_len, file_out) != entry->raw_len) {
+      ret = HUFF_ERR_WRITE;
+   }
+   free(in);
+   free(out);
+
+   return ret;
+}
+
+int check_archive(int fd, const struct archive_dir *dir, int threads, unsigned long *failed) {
+   // variable declarations
+   struct entry_slot *slots = NULL, *slot = NULL;
+   struct pool *pool = NULL;
+   unsigned long queued = 0, checked = 0;
+   int num_slots = 0, i = 0, ret = HUFF_OK;
+
+   if (threads > MAX_THREADS) {
+      threads = MAX_THREADS;
+   }
+   num_slots = (threads > 1) ? 2 * threads : 1;
+   if ((slots = (struct entry_slot *)calloc(num_slots, sizeof(struct entry_slot))) == NULL) {
+      return HUFF_ERR_MEMORY;
+   }
+   for (i = 0; i < num_slots; i++) {
+      init_decode_table(&slots[i].table);
+   }
+   if (threads > 1) {
+      pool = create_pool(threads);
+   }
+
+   // every entry is decoded by a worker and its blocks checked, the first
+   // entry that fails is the one reported
+   while (ret == HUFF_OK) {
+      while (queued < dir->count && queued - checked < num_slots) {
+         slot = &slots[queued % num_slots];
+         slot->fd = fd;
+         slot->entry = &dir->entries[queued];
+         submit_job(pool, &slot->job, check_entry, slot);
+         queued++;
+      }
+
+      if (checked == queued) {
+         break;
+      }
+
+      slot = &slots[checked % num_slots];
+      wait_job(pool, &slot->job);
+      if (slot->ret != HUFF_OK) {
+         *failed = checked;
+         ret = slot->ret;
+      }
+      checked++;
+   }
+
+   destroy_pool(pool);
+
+   for (i = 0; i < num_slots; i++) {
+      free(slots[i].in);
+      free(slots[i].out);
+      free_decode_table(&slots[i].table);
+   }
+   free(slots);
+
+   return ret;
+}
+
+void free_directory(struct archive_dir *dir) {
+   free(dir->entries);
+   free(dir->names);
+   dir->entries = NULL;
+   dir->names = NULL;
+   dir->count = 0;
+
+   return;
+}
+
+static void put_number(unsigned char *p, unsigned long num) {
+   p[0] = (unsigned char)(num >> 24);
+   p[1] = (unsigned char)(num >> 16);
+   p[2] = (unsigned char)(num >> 8);
+   p[3] = (unsigned char)num;
+
+   return;
+}
+
+static unsigned long get_number(const unsigned char *p) {
+   return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) | ((unsigned long)p[2] << 8) | p[3];
+}
+
+static void put_number64(unsigned char *p, unsigned long long num) {
+   put_number(p, (unsigned long)(num >> 32));
+   put_number(p + 4, (unsigned long)(num & 0xFFFFFFFF));
+
+   return;
+}
+
+static unsigned long long get_number64(const unsigned char *p) {
+   return ((unsigned long long)get_number(p) << 32) | get_number(p + 4);
+}
+
+static int grow_buffer(unsigned char **buf, unsigned long *cap, unsigned long need) {
+   // variable declarations
+   unsigned char *grown = NULL;
+
+   if (need <= *cap && *buf != NULL) {
+      return HUFF_OK;
+   }
+   if ((grown = (unsigned char *)realloc(*buf, need ? need : 1)) == NULL) {
+      return HUFF_ERR_MEMORY;
+   }
+   *buf = grown;
+   *cap = need;
+
+   return HUFF_OK;
+}
+
+static long read_at(int fd, unsigned char *buf, unsigned long len, unsigned long long offset) {
+   // variable declarations
+   unsigned long done = 0;
+   long ret = 0;
+
+   while (done < len) {
+      if ((ret = stats_pread(fd, buf + done, len - done, offset + done)) <= 0) {
+         break;
+      }
+      done += ret;
+   }
+
+   return done;
+}
+
+static int read_file(const char *name, unsigned char **buf, unsigned long *cap, unsigned long *len) {
+   // variable declarations
+   struct stat info;
+   long ret = 0;
+   int fd = 0;
+
+   if ((fd = open(name, O_RDONLY)) == -1) {
+      return HUFF_ERR_READ;
+   }
+
+   // room for the whole file and one more byte, so a small file takes one
+   // read and one more to see the end.  A file that grows meanwhile is read
+   // to its new end
+   *len = 0;
+   if (fstat(fd, &info) == 0 && grow_buffer(buf, cap, info.st_size + 1) != HUFF_OK) {
+      close(fd);
+      return HUFF_ERR_MEMORY;
+   }
+   for (;;) {
+      if (*len == *cap && grow_buffer(buf, cap, 2 * *cap + 4096) != HUFF_OK) {
+         close(fd);
+         return HUFF_ERR_MEMORY;
+      }
+      if ((ret = stats_read(fd, *buf + *len, *cap - *len)) < 0) {
+         close(fd);
+         return HUFF_ERR_READ;
+      }
+      if (ret == 0) {
+         break;
+      }
+      *len += ret;
+   }
+   close(fd);
+
+   return HUFF_OK;
+}
+
+static int decode_entry(int fd, const struct archive_entry *entry, unsigned char **in, unsigned long *in_cap,
+      unsigned char **out, unsigned long *out_cap, struct decode_table *table) {
+
+   // variable declarations
+   long done = 0;
+   int ret = HUFF_OK;
+
+   // an entry is read and decoded whole
+   if ((ret = grow_buffer(in, in_cap, entry->size)) != HUFF_OK) {
+      return ret;
+   }
+   if (read_at(fd, *in, entry->size, entry->offset) != (long)entry->size) {
+      return HUFF_ERR_CORRUPT;
+   }
+
+   // the directory's length is only trusted once the block prefixes of the
+   // stream add up to it, a damaged one must not size the output buffer
+   if ((done = stream_raw_size(*in, entry->size)) < 0) {
+      return (int)done;
+   }
+   if ((unsigned long long)done != entry->raw_len) {
+      return HUFF_ERR_CORRUPT;
+   }
+   if ((ret = grow_buffer(out, out_cap, entry->raw_len)) != HUFF_OK) {
+      return ret;
+   }
+   if ((done = decompress_buffer(*in, entry->size, *out, entry->raw_len, table)) < 0) {
+      return (int)done;
+   }
+
+   // the stream must hold exactly the characters the directory says
+   return ((unsigned long long)done == entry->raw_len) ? HUFF_OK : HUFF_ERR_CORRUPT;
+}
+
+static void compress_entry(void *arg) {
+   // variable declarations
+   struct entry_slot *slot = (struct entry_slot *)arg;
+   long size = 0;
+
+   if ((slot->ret = read_file(slot->name, &slot->in, &slot->in_cap, &slot->raw_len)) != HUFF_OK) {
+      return;
+   }
+   if ((slot->ret = grow_buffer(&slot->out, &slot->out_cap,
+         STREAM_BOUND(slot->raw_len, SPLIT_UNIT(slot->block_size, slot->split)))) != HUFF_OK) {
+      return;
+   }
+
+   size = compress_buffer(slot->in, slot->raw_len, slot->out, slot->out_cap, slot->block_size,
+         slot->streams, slot->split, slot->context, slot->checksum, slot->sample);
+   slot->ret = (size < 0) ? (int)size : HUFF_OK;
+   slot->size = (size < 0) ? 0 : size;
+
+   return;
+}
+
+static void check_entry(void *arg) {
+   // variable declarations
+   struct entry_slot *slot = (struct entry_slot *)arg;
+
+   slot->ret = decode_entry(slot->fd, slot->entry, &slot->in, &slot->in_cap, &slot->out, &slot->out_cap, &slot->table);
+
+   return;
+}
@@ -0,0 +1,67 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      Many files in one archive.  Every file is compressed into a complete
+ *      stream (see block_huff.h) with tables of its own, the streams are
+ *      written one after the other and a central directory at the end says
+ *      where each one is.  A reader goes from the footer to the directory
+ *      and from there straight to the entry it wants, nothing else in the
+ *      archive is read.  The files are compressed by a pool of workers,
+ *      each file whole and in memory by one of them, and written in the
+ *      order they were named.
+ *
+ *      Archive layout (all numbers most significant byte first):
+ *
+ *         magic number   4 bytes   0x4C 0x70 0xF0 0x79
+ *         flags          1 byte    zero
+ *         entries        a stream per file, magic number to footer
+ *         directory      one record per entry:
+ *                           offset      8 bytes  where its stream starts
+ *                           size        8 bytes  bytes of its stream
+ *                           characters  8 bytes  bytes of the file
+ *                           name length 2 bytes
+ *                           name        the path the file was named by
+ *         footer         8 bytes offset of the directory, 4 bytes number
+ *                        of entries and the 4 bytes 0x4C 0x70 0xF0 0x78
+ *
+ ***************************/
+
+#ifndef HUFFMAN_ARCHIVE
+#define HUFFMAN_ARCHIVE
+
+#include <stdio.h>
+
+#include "decode_huff.h"
+
+#define ARCHIVE_RECORD  26
+#define ARCHIVE_FOOTER  16
+#define MAX_ENTRY_NAME  65535
+#define ARCHIVE_MAGIC   0x79    // last byte of the header's magic number
+#define FOOTER_MAGIC    0x78    // last byte of the footer's magic number
+
+struct archive_entry {
+   unsigned long long offset;       // where the entry's stream starts in the archive
+   unsigned long long size;         // bytes of its stream
+   unsigned long long raw_len;      // bytes of the file
+   const char *name;
+};
+
+struct archive_dir {
+   struct archive_entry *entries;
+   unsigned long count;
+   char *names;                     // every name, each ending in a zero
+};
+
+// function prototypes
+int  compress_archive(FILE *file_out, char *names[], unsigned long num, unsigned long block_size, int threads,
+      int streams, int split, int context, int checksum, int sample, unsigned long *failed);
+int  read_directory(int fd, struct archive_dir *dir);
+long find_entry(const struct archive_dir *dir, const char *name);
+int  extract_entry(int fd, const struct archive_entry *entry, FILE *file_out, struct decode_table *table);
+int  check_archive(int fd, const struct archive_dir *dir, int threads, unsigned long *failed);
+void free_directory(struct archive_dir *dir);
+
+#endif //HUFFMAN_ARCHIVE
@@ -0,0 +1,493 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      The benchmark behind make bench.  It generates the same synthetic
+ *      inputs on every run (uniform random, Zipf skewed, text like, a single
+ *      character and all 256 characters equally) at several sizes and times
+ *      every phase of the compressor on its own: the character count,
+ *      generate_tree(), build_codes(), encoding (in one stream and in four
+ *      coded side by side) and decoding, followed by
+ *      the whole library round trip with one and with four streams and
+ *      with the context tables.  Each phase is repeated for at least
+ *      the minimum time and the fastest run is reported, one JSON object
+ *      per line on the standard output:
+ *
+ *         {"corpus":"zipf","size":1048576,"phase":"encode","seconds":...,
+ *          "mb_per_s":...,"ns_per_symbol":...,"ratio":...,"peak_rss_kb":...}
+ *
+ *      The ratio is the compressed size over the original size, the payload
+ *      alone for the encode and decode phases and the whole stream for the
+ *      library phases.  The peak RSS is that of the process so far.
+ *
+ ***************************/
+
+#include <stdio.h>         // printf(), fprintf()
+#include <stdlib.h>        // malloc(), free(), exit(), strtod(), strtoul()
+#include <string.h>        // memcmp(), strcmp()
+#include <unistd.h>        // getopt()
+#include <time.h>          // clock_gettime()
+#include <sys/resource.h>  // getrusage()
+
+#include "huff.h"
+#include "tree_huff.h"
+#include "encode_huff.h"
+#include "decode_huff.h"
+
+#define MAX_SIZES     16
+#define DEFAULT_TIME  0.2
+#define TEXT_WORDS    512
+
+// the inputs, generated from a fixed seed
+#define CORPUS_UNIFORM 0
+#define CORPUS_ZIPF    1
+#define CORPUS_TEXT    2
+#define CORPUS_SINGLE  3
+#define CORPUS_ALL256  4
+#define NUM_CORPORA    5
+
+// everything one round of phases works on
+struct bench_state {
+   const unsigned char *in;
+   unsigned long len;
+   int freq[MAX_CHARS];
+   struct huff_tree tree;
+   int root;
+   struct code code_values[MAX_CHARS];
+   struct encode_table encode;
+   struct decode_table decode;
+   unsigned char *payload;
+   unsigned long payload_cap;
+   unsigned long payload_len;
+   unsigned char *out;
+   unsigned char *stream;
+   unsigned long stream_cap;
+   long stream_len;
+   struct huff_ctx ctx;
+};
+
+// function prototypes
+unsigned long long next_random(unsigned long long *state);
+void generate_corpus(int corpus, unsigned char *buf, unsigned long len);
+double now(void);
+long peak_rss(void);
+void phase_count(struct bench_state *state);
+void phase_tree(struct bench_state *state);
+void phase_codes(struct bench_state *state);
+void phase_encode(struct bench_state *state);
+void phase_encode4(struct bench_state *state);
+void phase_decode(struct bench_state *state);
+void phase_compress(struct bench_state *state);
+void phase_decompress(struct bench_state *state);
+double time_phase(void (*phase)(struct bench_state *state), struct bench_state *state, double min_time);
+void report(const char *corpus, unsigned long len, const char *phase, double seconds, double ratio);
+
+int main(int argc, char *argv[]) {
+
+   // variable declarations
+   const char *const names[NUM_CORPORA] = {"uniform", "zipf", "text", "single", "all256"};
+   unsigned long sizes[MAX_SIZES] = {1ul << 16, 1ul << 20, 1ul << 24}, max_size = 0, bits = 0, need = 0;
+   int num_sizes = 3, custom = 0, opt = 0, corpus = 0, i = 0, c = 0, max_len = 0;
+   double min_time = DEFAULT_TIME, seconds = 0, ratio = 0;
+   unsigned char *buf = NULL;
+   struct bench_state state;
+
+   // -s KiB replaces the default sizes (it may be given several times),
+   // -t sets the minimum time spent on each phase
+   while ((opt = getopt(argc, argv, "s:t:")) != -1) {
+      if (opt == 's') {
+         if (!custom) {
+            custom = 1;
+            num_sizes = 0;
+         }
+         if (num_sizes < MAX_SIZES) {
+            sizes[num_sizes++] = strtoul(optarg, NULL, 10) * 1024;
+         }
+      } else if (opt == 't') {
+         min_time = strtod(optarg, NULL);
+      } else {
+         fprintf(stderr, "Format needs to be: ./benchmark [-s KiB]... [-t seconds]\n");
+         exit(1);
+      }
+   }
+
+   for (i = 0; i < num_sizes; i++) {
+      if (sizes[i] == 0) {
+         fprintf(stderr, "Sizes must be at least 1 KiB.\n");
+         exit(1);
+      }
+      if (sizes[i] > max_size) {
+         max_size = sizes[i];
+      }
+   }
+
+   // one set of buffers big enough for the largest size, the payload
+   // buffer grows to whatever the codes need
+   state.payload = NULL;
+   state.payload_cap = 0;
+   if ((buf = (unsigned char *)malloc(max_size)) == NULL ||
+         (state.out = (unsigned char *)malloc(max_size)) == NULL ||
+         huff_init(&state.ctx) != HUFF_OK) {
+      fprintf(stderr, "Failure to allocate the benchmark buffers.\n");
+      exit(1);
+   }
+   state.stream_cap = huff_compress_bound(&state.ctx, max_size);
+   if ((state.stream = (unsigned char *)malloc(state.stream_cap)) == NULL) {
+      fprintf(stderr, "Failure to allocate the benchmark buffers.\n");
+      exit(1);
+   }
+   init_decode_table(&state.decode);
+
+   for (corpus = 0; corpus < NUM_CORPORA; corpus++) {
+      for (i = 0; i < num_sizes; i++) {
+         generate_corpus(corpus, buf, sizes[i]);
+         state.in = buf;
+         state.len = sizes[i];
+
+         seconds = time_phase(phase_count, &state, min_time);
+         report(names[corpus], state.len, "histogram", seconds, 0);
+
+         seconds = time_phase(phase_tree, &state, min_time);
+         report(names[corpus], state.len, "generate_tree", seconds, 0);
+
+         // characters of an earlier corpus must not keep their codes
+         for (c = 0; c < MAX_CHARS; c++) {
+            state.code_values[c].ch = -1;
+            state.code_values[c].len = 0;
+            state.code_values[c].bits = 0;
+         }
+         seconds = time_phase(phase_codes, &state, min_time);
+         report(names[corpus], state.len, "build_codes", seconds, 0);
+
+         // the payload ratio follows from the code lengths, the four
+         // streams need room for their longest codes each
+         for (c = 0, bits = 0, max_len = 0; c < MAX_CHARS; c++) {
+            bits += (unsigned long)state.freq[c] * state.code_values[c].len;
+            if (state.freq[c] > 0 && state.code_values[c].len > max_len) {
+               max_len = state.code_values[c].len;
+            }
+         }
+         ratio = (double)((bits + 7) / 8) / state.len;
+         need = 4 * ((STREAM_SEGMENT(state.len) * max_len + 7) / 8 + 16);
+         if ((bits + 7) / 8 + 16 > need) {
+            need = (bits + 7) / 8 + 16;
+         }
+         if (need > state.payload_cap) {
+            state.payload_cap = need;
+            free(state.payload);
+            if ((state.payload = (unsigned char *)malloc(state.payload_cap)) == NULL) {
+               fprintf(stderr, "Failure to allocate the payload buffer.\n");
+               exit(1);
+            }
+         }
+
+         build_encode_table(&state.encode, state.code_values);
+         seconds = time_phase(phase_encode, &state, min_time);
+         report(names[corpus], state.len, "encode", seconds, ratio);
+
+         if (build_decode_table(&state.decode, &state.tree) != 0) {
+            fprintf(stderr, "Failure to build the decode table.\n");
+            exit(1);
+         }
+         seconds = time_phase(phase_decode, &state, min_time);
+         if (memcmp(state.out, state.in, state.len) != 0) {
+            fprintf(stderr, "The %s corpus did not decode to the original.\n", names[corpus]);
+            exit(1);
+         }
+         report(names[corpus], state.len, "decode", seconds, ratio);
+
+         // the four streams reuse the payload buffer the decoder just read
+         seconds = time_phase(phase_encode4, &state, min_time);
+         report(names[corpus], state.len, "encode4", seconds, (double)state.payload_len / state.len);
+
+         seconds = time_phase(phase_compress, &state, min_time);
+         if (state.stream_len < 0) {
+            fprintf(stderr, "Compression failed: %s.\n", huff_error_string(state.stream_len));
+            exit(1);
+         }
+         ratio = (double)state.stream_len / state.len;
+         report(names[corpus], state.len, "compress", seconds, ratio);
+
+         seconds = time_phase(phase_decompress, &state, min_time);
+         if (memcmp(state.out, state.in, state.len) != 0) {
+            fprintf(stderr, "The %s corpus did not decompress to the original.\n", names[corpus]);
+            exit(1);
+         }
+         report(names[corpus], state.len, "decompress", seconds, ratio);
+
+         // the same round trip with the four stream payload
+         state.ctx.streams = 4;
+         seconds = time_phase(phase_compress, &state, min_time);
+         if (state.stream_len < 0) {
+            fprintf(stderr, "Compression failed: %s.\n", huff_error_string(state.stream_len));
+            exit(1);
+         }
+         ratio = (double)state.stream_len / state.len;
+         report(names[corpus], state.len, "compress4", seconds, ratio);
+
+         seconds = time_phase(phase_decompress, &state, min_time);
+         if (memcmp(state.out, state.in, state.len) != 0) {
+            fprintf(stderr, "The %s corpus did not decompress to the original.\n", names[corpus]);
+            exit(1);
+         }
+         report(names[corpus], state.len, "decompress4", seconds, ratio);
+         state.ctx.streams = 1;
+
+         // and with the order-1 context tables
+         state.ctx.context = 1;
+         seconds = time_phase(phase_compress, &state, min_time);
+         if (state.stream_len < 0) {
+            fprintf(stderr, "Compression failed: %s.\n", huff_error_string(state.stream_len));
+            exit(1);
+         }
+         ratio = (double)state.stream_len / state.len;
+         report(names[corpus], state.len, "compress_context", seconds, ratio);
+
+         seconds = time_phase(phase_decompress, &state, min_time);
+         if (memcmp(state.out, state.in, state.len) != 0) {
+            fprintf(stderr, "The %s corpus did not decompress to the original.\n", names[corpus]);
+            exit(1);
+         }
+         report(names[corpus], state.len, "decompress_context", seconds, ratio);
+         state.ctx.context = 0;
+      }
+   }
+
+   free_decode_table(&state.decode);
+   huff_free(&state.ctx);
+   free(state.stream);
+   free(state.payload);
+   free(state.out);
+   free(buf);
+
+   return 0;
+}
+
+unsigned long long next_random(unsigned long long *state) {
+   // xorshift64*, the same sequence on every machine
+   *state ^= *state >> 12;
+   *state ^= *state << 25;
+   *state ^= *state >> 27;
+
+   return *state * 0x2545F4914F6CDD1DULL;
+}
+
+void generate_corpus(int corpus, unsigned char *buf, unsigned long len) {
+   // variable declarations
+   static const char *const syllables[] = {"the", "an", "ing", "er", "on", "re", "at", "en", "st", "ou",
+      "al", "is", "it", "or", "ti", "ar", "ed", "te", "nd", "es", "of", "to", "ha", "hu", "ff", "man"};
+   static const char punctuation[] = ",.;:!?";
+   unsigned long long seed = 0x9E3779B97F4A7C15ULL + corpus;
+   double cdf[MAX_CHARS], word_cdf[TEXT_WORDS], sum = 0, r = 0;
+   char words[TEXT_WORDS][24];
+   unsigned long i = 0, lo = 0, hi = 0;
+   int w = 0, n = 0, k = 0, line = 0;
+   const char *s = NULL;
+
+   switch (corpus) {
+      case CORPUS_UNIFORM:
+         for (i = 0; i < len; i++) {
+            buf[i] = (unsigned char)(next_random(&seed) >> 56);
+         }
+         break;
+
+      case CORPUS_ZIPF:
+         // the k-th most likely character has weight 1/k
+         for (k = 0, sum = 0; k < MAX_CHARS; k++) {
+            sum += 1.0 / (k + 1);
+            cdf[k] = sum;
+         }
+         for (i = 0; i < len; i++) {
+            r = (next_random(&seed) >> 11) * (1.0 / 9007199254740992.0) * sum;
+            for (lo = 0, hi = MAX_CHARS - 1; lo < hi; ) {
+               if (cdf[(lo + hi) / 2] < r) {
+                  lo = (lo + hi) / 2 + 1;
+               } else {
+                  hi = (lo + hi) / 2;
+               }
+            }
+            buf[i] = (unsigned char)lo;
+         }
+         break;
+
+      case CORPUS_TEXT:
+         // a vocabulary of made up words picked with Zipf weights, separated
+         // by spaces with the odd punctuation mark and line break
+         for (w = 0; w < TEXT_WORDS; w++) {
+            n = 1 + (int)(next_random(&seed) % 4);
+            words[w][0] = '\0';
+            for (k = 0; k < n; k++) {
+               strcat(words[w], syllables[next_random(&seed) % (sizeof(syllables) / sizeof(syllables[0]))]);
+            }
+         }
+         for (w = 0, sum = 0; w < TEXT_WORDS; w++) {
+            sum += 1.0 / (w + 1);
+            word_cdf[w] = sum;
+         }
+         for (i = 0; i < len; ) {
+            r = (next_random(&seed) >> 11) * (1.0 / 9007199254740992.0) * sum;
+            for (lo = 0, hi = TEXT_WORDS - 1; lo < hi; ) {
+               if (word_cdf[(lo + hi) / 2] < r) {
+                  lo = (lo + hi) / 2 + 1;
+               } else {
+                  hi = (lo + hi) / 2;
+               }
+            }
+            for (s = words[lo]; *s != '\0' && i < len; s++) {
+               buf[i++] = (line == 0 && s == words[lo]) ? (unsigned char)(*s - 'a' + 'A') : (unsigned char)*s;
+               line++;
+            }
+            if (i < len && next_random(&seed) % 10 == 0) {
+               buf[i++] = (unsigned char)punctuation[next_random(&seed) % (sizeof(punctuation) - 1)];
+            }
+            if (i < len) {
+               buf[i++] = (line > 70) ? '\n' : ' ';
+               line = (line > 70) ? 0 : line + 1;
+            }
+         }
+         break;
+
+      case CORPUS_SINGLE:
+         memset(buf, 'a', len);
+         break;
+
+      case CORPUS_ALL256:
+         // every character equally often, in a scrambled order
+         for (i = 0; i < len; i++) {
+            buf[i] = (unsigned char)((i * 167) ^ (i >> 8));
+         }
+         break;
+   }
+
+   return;
+}
+
+double now(void) {
+   // variable declarations
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+long peak_rss(void) {
+   // variable declarations
+   struct rusage usage;
+
+   if (getrusage(RUSAGE_SELF, &usage) != 0) {
+      return -1;
+   }
+
+   return usage.ru_maxrss;
+}
+
+void phase_count(struct bench_state *state) {
+   memset(state->freq, 0, sizeof(state->freq));
+   count_characters(state->in, state->len, state->freq);
+
+   return;
+}
+
+void phase_tree(struct bench_state *state) {
+   state->root = generate_tree(&state->tree, state->freq);
+
+   return;
+}
+
+void phase_codes(struct bench_state *state) {
+   build_codes(&state->tree, state->root, state->code_values, 0, 0);
+
+   return;
+}
+
+void phase_encode(struct bench_state *state) {
+   // variable declarations
+   struct bit_writer bw;
+
+   init_bit_writer_mem(&bw, state->payload, state->payload_cap);
+   encode_symbols(&state->encode, state->in, state->len, &bw);
+   align_bits(&bw);
+   state->payload_len = bw.pos;
+
+   return;
+}
+
+void phase_encode4(struct bench_state *state) {
+   // variable declarations
+   struct bit_writer bw[4];
+   unsigned long stride = state->payload_cap / 4;
+   int i = 0;
+
+   // each stream into its own quarter of the payload buffer
+   for (i = 0; i < 4; i++) {
+      init_bit_writer_mem(&bw[i], state->payload + i * stride, stride);
+   }
+   encode_symbols4(&state->encode, state->in, state->len, STREAM_SEGMENT(state->len), bw);
+   state->payload_len = 0;
+   for (i = 0; i < 4; i++) {
+      align_bits(&bw[i]);
+      state->payload_len += bw[i].pos;
+   }
+
+   return;
+}
+
+void phase_decode(struct bench_state *state) {
+   // variable declarations
+   struct bit_reader br;
+
+   init_bit_reader_mem(&br, state->payload, state->payload_len);
+   decode_symbols(&state->decode, &br, state->out, state->len);
+
+   return;
+}
+
+void phase_compress(struct bench_state *state) {
+   state->stream_len = huff_compress(&state->ctx, state->in, state->len, state->stream, state->stream_cap);
+
+   return;
+}
+
+void phase_decompress(struct bench_state *state) {
+   huff_decompress(&state->ctx, state->stream, state->stream_len, state->out, state->len);
+
+   return;
+}
+
+double time_phase(void (*phase)(struct bench_state *state), struct bench_state *state, double min_time) {
+   // variable declarations
+   double start = 0, end = 0, first = 0, best = 0;
+
+   // the first run warms the caches and is not counted
+   phase(state);
+
+   first = now();
+   do {
+      start = now();
+      phase(state);
+      end = now();
+      if (best == 0 || end - start < best) {
+         best = end - start;
+      }
+   } while (end - first < min_time);
+
+   return best;
+}
+
+void report(const char *corpus, unsigned long len, const char *phase, double seconds, double ratio) {
+
+   // guard the rates against a phase too quick for the clock
+   if (seconds <= 0) {
+      seconds = 1e-9;
+   }
+
+   printf("{\"corpus\":\"%s\",\"size\":%lu,\"phase\":\"%s\",\"seconds\":%.9f,"
+         "\"mb_per_s\":%.2f,\"ns_per_symbol\":%.3f,\"ratio\":%.4f,\"peak_rss_kb\":%ld}\n",
+         corpus, len, phase, seconds, len / seconds / 1e6, seconds * 1e9 / len, ratio, peak_rss());
+   fflush(stdout);
+
+   return;
+}
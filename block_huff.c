@@ -0,0 +1,1546 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      This file is the implementation code for the block based stream
+ *      format (see block_huff.h for the layout).  Each block gets its own
+ *      histogram, length limited canonical codes and payload.  Blocks are
+ *      built and decoded entirely in memory, the stream functions only move
+ *      whole blocks between the files and the buffers.  Files read in turn
+ *      and everything written goes through the I/O threads' rings (see
+ *      io_huff.h), so the next blocks are read and the last ones written
+ *      while the current ones are coded.
+ *
+ ***************************/
+
+#include <stdlib.h>  // malloc(), calloc(), realloc(), free()
+#include <string.h>  // memset(), memcpy(), memmove()
+#include <sys/stat.h>  // fstat()
+
+#include "block_huff.h"
+#include "encode_huff.h"
+#include "decode_huff.h"
+#include "pool_huff.h"
+#include "context_huff.h"
+#include "stats_huff.h"
+#include "io_huff.h"
+
+// the parts of a stream a push decoder works through
+#define PUSH_MAGIC   0
+#define PUSH_PREFIX  1
+#define PUSH_BLOCK   2
+#define PUSH_OUTPUT  3
+#define PUSH_INDEX   4
+#define PUSH_FOOTER  5
+#define PUSH_DONE    6
+#define PUSH_FAILED  7
+
+// one block on its way through a worker
+struct block_slot {
+   struct job job;
+   unsigned char *in;
+   unsigned long in_cap;
+   unsigned char *out;
+   unsigned long out_cap;
+   int type;
+   unsigned long raw_len;        // characters in the block
+   unsigned long size;           // bytes of the compressed block
+   int fd;                       // file to read the block from, -1 if already read
+   unsigned long long offset;    // where the block starts in that file
+   struct decode_table table;    // kept from block to block
+   int streams;                  // payload layout to compress with
+   int context;                  // nonzero to try order-1 context tables
+   int checksum;                 // nonzero when the blocks carry a CRC32C
+   int sample;                   // nonzero to sample the block before counting all of it
+   int ret;
+};
+
+// function prototypes
+static void put_number(unsigned char *p, unsigned long num);
+static unsigned long get_number(const unsigned char *p);
+static void put_number64(unsigned char *p, unsigned long long num);
+static unsigned long long get_number64(const unsigned char *p);
+static long read_full(int fd, unsigned char *buf, unsigned long len);
+static int  grow_buffer(unsigned char **buf, unsigned long *cap, unsigned long need);
+static int  add_index_entry(struct block_index *index, unsigned long long offset, unsigned long long raw_offset);
+static int  write_index(struct io_ring *ring, struct block_index *index, unsigned long long end);
+static int  check_index(struct io_ring *ring, const unsigned char prefix[BLOCK_PREFIX], const struct block_index *seen, unsigned long long end);
+static unsigned long long code_cost(int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS]);
+static unsigned char *put_table(unsigned char *p, int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS]);
+static const unsigned char *get_table(const unsigned char *p, const unsigned char *end, int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS]);
+static long finish_block(const unsigned char *in, unsigned long len, unsigned char *out, unsigned long cap, unsigned char *p, int type, int checksum);
+static long store_block(const unsigned char *in, unsigned long len, unsigned char *out, unsigned long cap, int checksum);
+static int  sample_incompressible(const unsigned char *in, unsigned long len);
+static int  gather_head(struct huff_push *push, unsigned long need, const unsigned char **p, const unsigned char *end);
+static int  decode_block(int type, const unsigned char *in, unsigned long size, unsigned char *out, unsigned long raw_len, struct decode_table *table);
+static void compress_slot(void *arg);
+static void decompress_slot(void *arg);
+
+long compress_block(const unsigned char *in, unsigned long len, unsigned char *out, unsigned long cap, int streams, int context, int checksum, int sample) {
+
+   // variable declarations
+   int freq[MAX_CHARS] = {0}, i = 0, g = 0, used = 0, ret = 0;
+   unsigned char lengths[MAX_CHARS] = {0}, *p = out + BLOCK_PREFIX, *jump = NULL;
+   unsigned long seg = 0, start = 0, num = 0, coded = 0, stride = 0;
+   struct code code_values[MAX_CHARS] = {{-1, 0, 0}};
+   struct encode_table encode[MAX_CONTEXT_GROUPS];
+   struct context_model model;
+   struct bit_writer bw[4];
+
+   if (cap < BLOCK_BOUND(len)) {
+      return HUFF_ERR_SPACE;
+   }
+
+   // a block a small sample already says is incompressible is not counted
+   if (sample && len >= SAMPLE_MIN && sample_incompressible(in, len)) {
+      return store_block(in, len, out, cap, checksum);
+   }
+
+   // getting the frequency of each character in the block
+   count_characters(in, len, freq);
+
+   generate_code_lengths(freq, lengths, CANONICAL_MAX_LEN);
+
+   // the four streams restart the contexts at every segment
+   seg = (streams == 4) ? STREAM_SEGMENT(len) : len;
+
+   // the size of the single table block, its table and payload
+   for (i = 0; i < MAX_CHARS; i++) {
+      used += (freq[i] != 0);
+   }
+   coded = 32 + (used + 1) / 2 + (code_cost(freq, lengths) + 7) / 8;
+
+   // a context block is only worth it when its tables and payload come to
+   // less than the single table block (the byte alignment of the streams
+   // is the same for both)
+   if (context && len > 0) {
+      STATS_BEGIN(PHASE_MODEL);
+      ret = build_context_model(in, len, seg, &model);
+      STATS_END();
+      if (ret != 0) {
+         return HUFF_ERR_MEMORY;
+      }
+      if (context_header_size(&model) + (model.bits + 7) / 8 < coded) {
+         coded = context_header_size(&model) + (model.bits + 7) / 8;
+      } else {
+         context = 0;
+      }
+   } else {
+      context = 0;
+   }
+
+   // a block the codes barely shrink is stored as it is, which costs a
+   // memcpy() to write and to read back
+   if (streams == 4) {
+      coded += JUMP_TABLE;
+   }
+   if (coded + len / STORE_GAIN >= len) {
+      return store_block(in, len, out, cap, checksum);
+   }
+
+   if (context) {
+      // the group count, the group of every previous character (high
+      // nibble first) and the groups' tables
+      *p++ = (unsigned char)model.groups;
+      for (i = 0; i < MAX_CHARS; i += 2) {
+         *p++ = (unsigned char)((model.map[i] << 4) | model.map[i + 1]);
+      }
+      for (g = 0; g < model.groups; g++) {
+         p = put_table(p, model.freq[g], model.lengths[g]);
+         STATS_CODES(model.freq[g], model.lengths[g]);
+         build_canonical_codes(model.freq[g], model.lengths[g], code_values);
+         build_encode_table(&encode[g], code_values);
+      }
+   } else {
+      p = put_table(p, freq, lengths);
+      STATS_CODES(freq, lengths);
+      build_canonical_codes(freq, lengths, code_values);
+      build_encode_table(&encode[0], code_values);
+   }
+
+   // the payload, in one piece or as four streams behind a jump table of
+   // the sizes of the first three
+   if (streams == 4) {
+      jump = p;
+      p += JUMP_TABLE;
+   }
+   if (streams == 4 && !context) {
+      // the four streams are coded side by side, each into a stretch of
+      // the buffer long enough for its longest codes, then moved together
+      stride = (seg * encode[0].max_len + 7) / 8 + 16;
+      if (cap - (p - out) < 4 * stride) {
+         return HUFF_ERR_SPACE;
+      }
+      for (i = 0; i < 4; i++) {
+         init_bit_writer_mem(&bw[i], p + i * stride, stride);
+      }
+      encode_symbols4(&encode[0], in, len, seg, bw);
+      for (i = 0; i < 4; i++) {
+         align_bits(&bw[i]);
+         if (bw[i].error) {
+            return HUFF_ERR_SPACE;
+         }
+         memmove(p, bw[i].buf, bw[i].pos);
+         if (i < 3) {
+            put_number(jump + 4 * i, bw[i].pos);
+         }
+         p += bw[i].pos;
+      }
+   } else {
+      for (i = 0; i < streams; i++) {
+         start = (len > i * seg) ? i * seg : len;
+         num = (len - start < seg) ? len - start : seg;
+         init_bit_writer_mem(&bw[0], p, cap - (p - out));
+         if (context) {
+            encode_symbols_context(encode, model.map, in + start, num, &bw[0]);
+         } else {
+            encode_symbols(&encode[0], in + start, num, &bw[0]);
+         }
+         align_bits(&bw[0]);
+         if (bw[0].error) {
+            return HUFF_ERR_SPACE;
+         }
+         if (streams == 4 && i < 3) {
+            put_number(jump + 4 * i, bw[0].pos);
+         }
+         p += bw[0].pos;
+      }
+   }
+
+   if (context) {
+      return finish_block(in, len, out, cap, p, (streams == 4) ? BLOCK_CONTEXT4 : BLOCK_CONTEXT, checksum);
+   }
+
+   return finish_block(in, len, out, cap, p, (streams == 4) ? BLOCK_HUFFMAN4 : BLOCK_HUFFMAN, checksum);
+}
+
+int read_block_prefix(const unsigned char prefix[BLOCK_PREFIX], int *type,
+      unsigned long *raw_len, unsigned long *size) {
+
+   *type = prefix[0];
+   *raw_len = get_number(prefix + 1);
+   *size = get_number(prefix + 5);
+
+   // the end block counts blocks instead of characters
+   if (*type == BLOCK_END) {
+      return HUFF_OK;
+   }
+
+   // nothing larger than a maximum block can be legitimate
+   if (*type > BLOCK_STORED || *raw_len > MAX_BLOCK_SIZE || *size > BLOCK_BOUND(MAX_BLOCK_SIZE)) {
+      return HUFF_ERR_CORRUPT;
+   }
+
+   return HUFF_OK;
+}
+
+int decompress_block(int type, const unsigned char *in, unsigned long size,
+      unsigned char *out, unsigned long raw_len, struct decode_table *table, int checksum) {
+
+   // variable declarations
+   unsigned int crc = 0;
+   int ret = HUFF_OK;
+
+   STATS_ADD(STAT_BLOCKS, 1);
+   STATS_ADD(STAT_RAW_BYTES, raw_len);
+   STATS_ADD(STAT_PACKED_BYTES, BLOCK_PREFIX + size);
+
+   if (!checksum) {
+      return decode_block(type, in, size, out, raw_len, table);
+   }
+
+   // the checksum is the last 4 bytes, the block before it is decoded as usual
+   if (size < CHECKSUM_SIZE) {
+      return HUFF_ERR_CORRUPT;
+   }
+   if ((ret = decode_block(type, in, size - CHECKSUM_SIZE, out, raw_len, table)) != HUFF_OK) {
+      return ret;
+   }
+   STATS_BEGIN(PHASE_CHECKSUM);
+   crc = crc32c(0, out, raw_len);
+   STATS_END();
+
+   return (crc == get_number(in + size - CHECKSUM_SIZE)) ? HUFF_OK : HUFF_ERR_CHECKSUM;
+}
+
+unsigned long split_point(const unsigned char *in, unsigned long len, int level, int streams, int checksum) {
+
+   // variable declarations
+   int block[MAX_CHARS] = {0}, window[MAX_CHARS], merged[MAX_CHARS], i = 0, used = 0;
+   unsigned char block_lengths[MAX_CHARS], window_lengths[MAX_CHARS], merged_lengths[MAX_CHARS];
+   unsigned long size = SPLIT_WINDOW(level), pos = 0;
+   unsigned long long header = 0, apart = 0, together = 0;
+
+   if (level <= 0 || len < 2 * size) {
+      return len;
+   }
+
+   count_characters(in, size, block);
+   generate_code_lengths(block, block_lengths, CANONICAL_MAX_LEN);
+
+   // grow the block a window at a time, for each window weigh coding it
+   // with the block's table against a table of its own plus the header,
+   // checksum and index entry a new block costs.  The last partial
+   // window stays
+   for (pos = size; pos + size <= len; pos += size) {
+      memset(window, 0, sizeof(window));
+      count_characters(in + pos, size, window);
+
+      used = 0;
+      for (i = 0; i < MAX_CHARS; i++) {
+         merged[i] = block[i] + window[i];
+         used += (window[i] != 0);
+      }
+      generate_code_lengths(window, window_lengths, CANONICAL_MAX_LEN);
+      generate_code_lengths(merged, merged_lengths, CANONICAL_MAX_LEN);
+
+      header = 8 * (BLOCK_PREFIX + 32 + (used + 1) / 2 + INDEX_ENTRY + ((streams == 4) ? JUMP_TABLE : 0) + (checksum ? CHECKSUM_SIZE : 0));
+      apart = code_cost(block, block_lengths) + code_cost(window, window_lengths) + header;
+      together = code_cost(merged, merged_lengths);
+      if (apart < together) {
+         return pos;
+      }
+
+      memcpy(block, merged, sizeof(block));
+      memcpy(block_lengths, merged_lengths, sizeof(block_lengths));
+   }
+
+   return len;
+}
+
+int compress_stream(int fd_in, int fd_out, unsigned long block_size, int threads, int streams, int split, int context, int checksum, int sample) {
+
+   // variable declarations
+   unsigned char header[5] = {0x4C, 0x70, 0xF0, 0x7E, 0x00};
+   struct block_slot *slots = NULL, *slot = NULL;
+   struct block_index index = {NULL, 0, 0};
+   struct pool *pool = NULL;
+   struct io_ring reader, writer;
+   unsigned char *carry = NULL;
+   unsigned long long offset = sizeof(header), raw_offset = 0;
+   unsigned long queued = 0, written = 0, carried = 0, carry_cap = 0, want = 0, len = 0;
+   int num_slots = 0, i = 0, eof = 0, rings = 0, ret = HUFF_OK;
+   long got = 0;
+
+   // keep two blocks per worker in flight so nobody waits on the reader,
+   // the pool has no more than MAX_THREADS workers to keep busy
+   if (threads > MAX_THREADS) {
+      threads = MAX_THREADS;
+   }
+   num_slots = (threads > 1) ? 2 * threads : 1;
+   if ((slots = (struct block_slot *)calloc(num_slots, sizeof(struct block_slot))) == NULL) {
+      return HUFF_ERR_MEMORY;
+   }
+   for (i = 0; i < num_slots && ret == HUFF_OK; i++) {
+      if (grow_buffer(&slots[i].in, &slots[i].in_cap, block_size) != HUFF_OK ||
+            grow_buffer(&slots[i].out, &slots[i].out_cap, BLOCK_BOUND(block_size)) != HUFF_OK) {
+         ret = HUFF_ERR_MEMORY;
+      }
+   }
+   if (split > 0 && ret == HUFF_OK && grow_buffer(&carry, &carry_cap, block_size) != HUFF_OK) {
+      ret = HUFF_ERR_MEMORY;
+   }
+   if (threads > 1) {
+      pool = create_pool(threads);
+   }
+
+   // the input is read ahead of the workers and the output written behind them
+   if (ret == HUFF_OK && start_reader(fd_in, &reader) != 0) {
+      ret = HUFF_ERR_MEMORY;
+   } else if (ret == HUFF_OK && start_writer(fd_out, &writer) != 0) {
+      stop_reader(&reader);
+      ret = HUFF_ERR_MEMORY;
+   } else if (ret == HUFF_OK) {
+      rings = 1;
+   }
+
+   if (checksum) {
+      header[4] |= STREAM_CHECKSUM;
+   }
+   if (ret == HUFF_OK && ring_write(&writer, header, sizeof(header)) != 0) {
+      ret = HUFF_ERR_WRITE;
+   }
+
+   while (ret == HUFF_OK) {
+      // hand out blocks while there is input and a free slot, the last one may be short
+      while (ret == HUFF_OK && (!eof || carried > 0) && queued - written < num_slots) {
+         slot = &slots[queued % num_slots];
+
+         // what was left over from a split block comes first
+         if (carried > 0) {
+            memcpy(slot->in, carry, carried);
+         }
+         want = eof ? 0 : block_size - carried;
+         if ((got = (want > 0) ? ring_read(&reader, slot->in + carried, want) : 0) < 0) {
+            ret = HUFF_ERR_READ;
+            break;
+         }
+         len = got;
+         slot->raw_len = carried + len;
+         carried = 0;
+         if (len < want) {
+            eof = 1;
+         }
+         if (slot->raw_len == 0) {
+            break;
+         }
+
+         // a block cut short hands the rest to the next one
+         if (split > 0) {
+            STATS_BEGIN(PHASE_MODEL);
+            len = split_point(slot->in, slot->raw_len, split, streams, checksum);
+            STATS_END();
+            carried = slot->raw_len - len;
+            memcpy(carry, slot->in + len, carried);
+            slot->raw_len = len;
+         }
+         slot->streams = streams;
+         slot->context = context;
+         slot->checksum = checksum;
+         slot->sample = sample;
+         submit_job(pool, &slot->job, compress_slot, slot);
+         queued++;
+      }
+
+      if (written == queued) {
+         break;
+      }
+
+      // the blocks are written out in order
+      slot = &slots[written % num_slots];
+      wait_job(pool, &slot->job);
+      if (slot->ret != HUFF_OK) {
+         ret = slot->ret;
+      } else if (ring_write(&writer, slot->out, slot->size) != 0) {
+         ret = HUFF_ERR_WRITE;
+      } else if ((ret = add_index_entry(&index, offset, raw_offset)) == HUFF_OK) {
+         offset += slot->size;
+         raw_offset += slot->raw_len;
+      }
+      written++;
+   }
+
+   // the workers finish whatever is still queued before the buffers go away
+   destroy_pool(pool);
+
+   if (ret == HUFF_OK) {
+      ret = write_index(&writer, &index, offset);
+   }
+
+   // the last buffers are written out before the writer stops
+   if (rings) {
+      stop_reader(&reader);
+      if (stop_writer(&writer) != 0 && ret == HUFF_OK) {
+         ret = HUFF_ERR_WRITE;
+      }
+   }
+
+   for (i = 0; i < num_slots; i++) {
+      free(slots[i].in);
+      free(slots[i].out);
+   }
+   free(slots);
+   free(carry);
+   free(index.entries);
+
+   return ret;
+}
+
+int decompress_stream(int fd, int fd_out, int threads) {
+
+   // variable declarations
+   unsigned char prefix[BLOCK_PREFIX], flags = 0;
+   struct block_slot *slots = NULL, *slot = NULL;
+   struct block_index index = {NULL, 0, 0}, seen = {NULL, 0, 0};
+   struct pool *pool = NULL;
+   struct io_ring reader, writer;
+   unsigned long long offset = 5, raw_offset = 0;
+   unsigned long queued = 0, written = 0;
+   int num_slots = 0, i = 0, done = 0, reading = 0, writing = 0, ret = HUFF_OK;
+
+   // the magic number has already been checked
+   if (read_full(fd, &flags, 1) != 1 || (flags & ~STREAM_CHECKSUM) != 0) {
+      return HUFF_ERR_CORRUPT;
+   }
+
+   if (threads > MAX_THREADS) {
+      threads = MAX_THREADS;
+   }
+   num_slots = (threads > 1) ? 2 * threads : 1;
+   if ((slots = (struct block_slot *)calloc(num_slots, sizeof(struct block_slot))) == NULL) {
+      return HUFF_ERR_MEMORY;
+   }
+   for (i = 0; i < num_slots; i++) {
+      init_decode_table(&slots[i].table);
+      slots[i].checksum = flags & STREAM_CHECKSUM;
+   }
+   if (threads > 1) {
+      pool = create_pool(threads);
+
+      // with the index every worker reads its own block straight from the file,
+      // without one (a pipe, or an index that does not check out) the blocks
+      // are read in turn from just after the flags byte
+      read_index(fd, &index);
+   }
+
+   // blocks read in turn are read ahead, the output is written behind
+   if (index.entries == NULL) {
+      if (start_reader(fd, &reader) != 0) {
+         ret = HUFF_ERR_MEMORY;
+      } else {
+         reading = 1;
+      }
+   }
+   if (fd_out >= 0 && ret == HUFF_OK) {
+      if (start_writer(fd_out, &writer) != 0) {
+         ret = HUFF_ERR_MEMORY;
+      } else {
+         writing = 1;
+      }
+   }
+
+   while (ret == HUFF_OK) {
+      // hand out blocks while there are any and a free slot
+      while (ret == HUFF_OK && !done && queued - written < num_slots) {
+         slot = &slots[queued % num_slots];
+         slot->fd = -1;
+
+         if (index.entries != NULL) {
+            // the index lists every block, the end block is not needed
+            if (queued == index.count) {
+               done = 1;
+               break;
+            }
+            slot->fd = fd;
+            slot->offset = index.entries[queued].offset;
+         } else {
+            // otherwise the blocks are read one after the other
+            if (ring_read(&reader, prefix, BLOCK_PREFIX) != BLOCK_PREFIX) {
+               ret = HUFF_ERR_CORRUPT;
+               break;
+            }
+            if ((ret = read_block_prefix(prefix, &slot->type, &slot->raw_len, &slot->size)) != HUFF_OK) {
+               break;
+            }
+            if (slot->type == BLOCK_END) {
+               done = 1;
+               break;
+            }
+            if ((ret = grow_buffer(&slot->in, &slot->in_cap, slot->size)) != HUFF_OK) {
+               break;
+            }
+            if (ring_read(&reader, slot->in, slot->size) != slot->size) {
+               ret = HUFF_ERR_CORRUPT;
+               break;
+            }
+         }
+
+         submit_job(pool, &slot->job, decompress_slot, slot);
+         queued++;
+      }
+
+      if (written == queued) {
+         break;
+      }
+
+      // the blocks are written out in order, or only checked without a file.
+      // An index must list them one after the other as they were found, read
+      // in turn they are listed here to check the index at the end against
+      slot = &slots[written % num_slots];
+      wait_job(pool, &slot->job);
+      if (slot->ret != HUFF_OK) {
+         ret = slot->ret;
+      } else if (index.entries != NULL && (index.entries[written].offset != offset || index.entries[written].raw_offset != raw_offset)) {
+         ret = HUFF_ERR_CORRUPT;
+      } else if (writing && ring_write(&writer, slot->out, slot->raw_len) != 0) {
+         ret = HUFF_ERR_WRITE;
+      } else if (index.entries == NULL && fd_out < 0) {
+         ret = add_index_entry(&seen, offset, raw_offset);
+      }
+      offset += BLOCK_PREFIX + slot->size;
+      raw_offset += slot->raw_len;
+      written++;
+   }
+
+   // the last block ends where the end block starts.  Decoding stops there,
+   // checking goes on through the index and footer to the end of the input
+   // so the result is the same whether the blocks were read in turn or not
+   if (ret == HUFF_OK && index.entries != NULL && offset != index.end) {
+      ret = HUFF_ERR_CORRUPT;
+   } else if (ret == HUFF_OK && index.entries == NULL && fd_out < 0) {
+      ret = check_index(&reader, prefix, &seen, offset);
+   }
+
+   destroy_pool(pool);
+
+   if (reading) {
+      stop_reader(&reader);
+   }
+   if (writing && stop_writer(&writer) != 0 && ret == HUFF_OK) {
+      ret = HUFF_ERR_WRITE;
+   }
+
+   for (i = 0; i < num_slots; i++) {
+      free(slots[i].in);
+      free(slots[i].out);
+      free_decode_table(&slots[i].table);
+   }
+   free(slots);
+   free(index.entries);
+   free(seen.entries);
+
+   return ret;
+}
+
+int decompress_range(int fd, FILE *file_out, unsigned long long start, unsigned long long len) {
+
+   // variable declarations
+   unsigned char prefix[BLOCK_PREFIX], flags = 0, *in = NULL, *out = NULL;
+   unsigned long in_cap = 0, out_cap = 0, raw_len = 0, size = 0, block = 0, lo = 0, hi = 0, skip = 0, num = 0;
+   unsigned long long end = start + len, raw_offset = 0, offset = 0;
+   struct block_index index = {NULL, 0, 0};
+   struct decode_table table;
+   int type = 0, ret = HUFF_OK;
+   long got = 0;
+
+   // the magic number has already been checked
+   if (read_full(fd, &flags, 1) != 1 || (flags & ~STREAM_CHECKSUM) != 0) {
+      return HUFF_ERR_CORRUPT;
+   }
+   if (end < start) {
+      end = ~0ULL;
+   }
+
+   // the index lists where every block starts, so reading begins at the
+   // last block starting at or before the range.  Without one (a pipe, or
+   // an index that does not check out, which read_index() leaves empty and
+   // the descriptor just after the flags byte) the blocks before the range
+   // are read past but not decoded
+   if (read_index(fd, &index) == HUFF_OK && index.count > 0) {
+      lo = 0;
+      hi = index.count;
+      while (hi - lo > 1) {
+         if (index.entries[(lo + hi) / 2].raw_offset <= start) {
+            lo = (lo + hi) / 2;
+         } else {
+            hi = (lo + hi) / 2;
+         }
+      }
+      block = lo;
+      raw_offset = index.entries[lo].raw_offset;
+   }
+
+   init_decode_table(&table);
+
+   while (raw_offset < end) {
+      if (index.entries != NULL) {
+         if (block == index.count) {
+            break;
+         }
+         offset = index.entries[block].offset;
+         if (index.entries[block].raw_offset != raw_offset || stats_pread(fd, prefix, BLOCK_PREFIX, offset) != BLOCK_PREFIX) {
+            ret = HUFF_ERR_CORRUPT;
+            break;
+         }
+      } else if (read_full(fd, prefix, BLOCK_PREFIX) != BLOCK_PREFIX) {
+         ret = HUFF_ERR_CORRUPT;
+         break;
+      }
+      if ((ret = read_block_prefix(prefix, &type, &raw_len, &size)) != HUFF_OK || type == BLOCK_END) {
+         break;
+      }
+      if ((ret = grow_buffer(&in, &in_cap, size)) != HUFF_OK) {
+         break;
+      }
+      got = (index.entries != NULL) ? stats_pread(fd, in, size, offset + BLOCK_PREFIX) : read_full(fd, in, size);
+      if (got != (long)size) {
+         ret = HUFF_ERR_CORRUPT;
+         break;
+      }
+      block++;
+
+      // only the part of the block inside the range is written
+      if (raw_offset + raw_len > start) {
+         if ((ret = grow_buffer(&out, &out_cap, raw_len)) != HUFF_OK) {
+            break;
+         }
+         if ((ret = decompress_block(type, in, size, out, raw_len, &table, flags & STREAM_CHECKSUM)) != HUFF_OK) {
+            break;
+         }
+         skip = (start > raw_offset) ? start - raw_offset : 0;
+         num = ((end - raw_offset < raw_len) ? end - raw_offset : raw_len) - skip;
+         if (stats_fwrite(out + skip, num, file_out) != num) {
+            ret = HUFF_ERR_WRITE;
+            break;
+         }
+      }
+      raw_offset += raw_len;
+   }
+
+   free(in);
+   free(out);
+   free(index.entries);
+   free_decode_table(&table);
+
+   return ret;
+}
+
+long compress_buffer(const unsigned char *in, unsigned long len, unsigned char *out,
+      unsigned long cap, unsigned long block_size, int streams, int split, int context, int checksum, int sample) {
+
+   // variable declarations
+   unsigned char *p = out, *end = NULL;
+   unsigned long pos = 0, count = 0, num = 0;
+   unsigned long long raw_offset = 0;
+   long size = 0;
+
+   if (cap < STREAM_BOUND(len, SPLIT_UNIT(block_size, split))) {
+      return HUFF_ERR_SPACE;
+   }
+
+   // the same layout as a stream file, magic number and flags
+   p[0] = 0x4C;
+   p[1] = 0x70;
+   p[2] = 0xF0;
+   p[3] = 0x7E;
+   p[4] = checksum ? STREAM_CHECKSUM : 0x00;
+   p += 5;
+
+   for (pos = 0; pos < len; pos += num) {
+      num = (len - pos < block_size) ? len - pos : block_size;
+      STATS_BEGIN(PHASE_MODEL);
+      num = split_point(in + pos, num, split, streams, checksum);
+      STATS_END();
+      if ((size = compress_block(in + pos, num, p, cap - (p - out), streams, context, checksum, sample)) < 0) {
+         return size;
+      }
+      p += size;
+      count++;
+   }
+
+   // the end block and the index, the block offsets are found again by
+   // stepping over the prefixes just written
+   end = p;
+   p[0] = BLOCK_END;
+   put_number(p + 1, count);
+   put_number(p + 5, count * INDEX_ENTRY + INDEX_FOOTER);
+   p += BLOCK_PREFIX;
+
+   for (pos = 5; pos < (unsigned long)(end - out); pos += BLOCK_PREFIX + get_number(out + pos + 5)) {
+      put_number64(p, pos);
+      put_number64(p + 8, raw_offset);
+      raw_offset += get_number(out + pos + 1);
+      p += INDEX_ENTRY;
+   }
+
+   put_number64(p, end - out);
+   p[8] = 0x4C;
+   p[9] = 0x70;
+   p[10] = 0xF0;
+   p[11] = 0x7F;
+   p += INDEX_FOOTER;
+
+   return p - out;
+}
+
+long stream_raw_size(const unsigned char *in, unsigned long len) {
+   // variable declarations
+   unsigned long pos = 5, raw_len = 0, size = 0, total = 0;
+   int type = 0, ret = 0;
+
+   if (len < 5 || in[0] != 0x4C || in[1] != 0x70 || in[2] != 0xF0 || in[3] != 0x7E) {
+      return HUFF_ERR_CORRUPT;
+   }
+
+   // add up the character counts of the blocks up to the end block
+   for (;;) {
+      if (len - pos < BLOCK_PREFIX) {
+         return HUFF_ERR_CORRUPT;
+      }
+      if ((ret = read_block_prefix(in + pos, &type, &raw_len, &size)) != HUFF_OK) {
+         return ret;
+      }
+      if (type == BLOCK_END) {
+         return total;
+      }
+      if (len - pos - BLOCK_PREFIX < size) {
+         return HUFF_ERR_CORRUPT;
+      }
+      total += raw_len;
+      pos += BLOCK_PREFIX + size;
+   }
+}
+
+long decompress_buffer(const unsigned char *in, unsigned long len, unsigned char *out,
+      unsigned long cap, struct decode_table *table) {
+
+   // variable declarations
+   unsigned long pos = 5, raw_len = 0, size = 0, done = 0;
+   int type = 0, ret = 0;
+
+   if (len < 5 || in[0] != 0x4C || in[1] != 0x70 || in[2] != 0xF0 || in[3] != 0x7E || (in[4] & ~STREAM_CHECKSUM) != 0) {
+      return HUFF_ERR_CORRUPT;
+   }
+
+   for (;;) {
+      if (len - pos < BLOCK_PREFIX) {
+         return HUFF_ERR_CORRUPT;
+      }
+      if ((ret = read_block_prefix(in + pos, &type, &raw_len, &size)) != HUFF_OK) {
+         return ret;
+      }
+      if (len - pos - BLOCK_PREFIX < size) {
+         return HUFF_ERR_CORRUPT;
+      }
+      pos += BLOCK_PREFIX;
+
+      // the end block must close the buffer
+      if (type == BLOCK_END) {
+         return (pos + size == len) ? (long)done : HUFF_ERR_CORRUPT;
+      }
+
+      if (cap - done < raw_len) {
+         return HUFF_ERR_SPACE;
+      }
+      if ((ret = decompress_block(type, in + pos, size, out + done, raw_len, table, in[4] & STREAM_CHECKSUM)) != HUFF_OK) {
+         return ret;
+      }
+      done += raw_len;
+      pos += size;
+   }
+}
+
+long decompress_range_buffer(const unsigned char *in, unsigned long len, unsigned long long start,
+      unsigned char *out, unsigned long count, struct decode_table *table,
+      unsigned char **scratch, unsigned long *scratch_cap) {
+
+   // variable declarations
+   const unsigned char *entries = NULL;
+   unsigned long end = 0, blocks = 0, block = 0, lo = 0, hi = 0, pos = 0, raw_len = 0, size = 0, skip = 0, num = 0, done = 0;
+   unsigned long long raw_offset = 0;
+   int type = 0, ret = 0;
+
+   if (len < 5 + BLOCK_PREFIX + INDEX_FOOTER || in[0] != 0x4C || in[1] != 0x70 || in[2] != 0xF0 || in[3] != 0x7E ||
+         (in[4] & ~STREAM_CHECKSUM) != 0) {
+      return HUFF_ERR_CORRUPT;
+   }
+
+   // the footer points back to the end block and the index behind it
+   if (in[len - 4] != 0x4C || in[len - 3] != 0x70 || in[len - 2] != 0xF0 || in[len - 1] != 0x7F ||
+         get_number64(in + len - INDEX_FOOTER) > len - INDEX_FOOTER - BLOCK_PREFIX) {
+      return HUFF_ERR_CORRUPT;
+   }
+   end = get_number64(in + len - INDEX_FOOTER);
+   blocks = get_number(in + end + 1);
+   if (in[end] != BLOCK_END || get_number(in + end + 5) != blocks * INDEX_ENTRY + INDEX_FOOTER ||
+         end + BLOCK_PREFIX + get_number(in + end + 5) != len) {
+      return HUFF_ERR_CORRUPT;
+   }
+   entries = in + end + BLOCK_PREFIX;
+
+   // start from the last block that begins at or before the range
+   hi = blocks;
+   while (hi - lo > 1) {
+      if (get_number64(entries + (lo + hi) / 2 * INDEX_ENTRY + 8) <= start) {
+         lo = (lo + hi) / 2;
+      } else {
+         hi = (lo + hi) / 2;
+      }
+   }
+
+   for (block = lo; block < blocks && done < count; block++) {
+      pos = get_number64(entries + block * INDEX_ENTRY);
+      raw_offset = get_number64(entries + block * INDEX_ENTRY + 8);
+      if (pos > end - BLOCK_PREFIX) {
+         return HUFF_ERR_CORRUPT;
+      }
+      if ((ret = read_block_prefix(in + pos, &type, &raw_len, &size)) != HUFF_OK) {
+         return ret;
+      }
+      if (type == BLOCK_END || end - pos - BLOCK_PREFIX < size) {
+         return HUFF_ERR_CORRUPT;
+      }
+
+      // a range starting past the last character is empty
+      if (raw_offset + raw_len <= start) {
+         break;
+      }
+
+      // whole blocks go straight to the output, the ends of the range
+      // are decoded to the scratch buffer and copied
+      skip = (start > raw_offset) ? start - raw_offset : 0;
+      num = (raw_len - skip < count - done) ? raw_len - skip : count - done;
+      if (skip == 0 && num == raw_len) {
+         ret = decompress_block(type, in + pos + BLOCK_PREFIX, size, out + done, raw_len, table, in[4] & STREAM_CHECKSUM);
+      } else if ((ret = grow_buffer(scratch, scratch_cap, raw_len)) == HUFF_OK &&
+            (ret = decompress_block(type, in + pos + BLOCK_PREFIX, size, *scratch, raw_len, table, in[4] & STREAM_CHECKSUM)) == HUFF_OK) {
+         memcpy(out + done, *scratch + skip, num);
+      }
+      if (ret != HUFF_OK) {
+         return ret;
+      }
+      done += num;
+   }
+
+   return done;
+}
+
+int read_index(int fd, struct block_index *index) {
+   // variable declarations
+   unsigned char footer[INDEX_FOOTER], prefix[BLOCK_PREFIX], entry[INDEX_ENTRY];
+   unsigned long long end = 0, start = 0;
+   unsigned long i = 0;
+   struct stat info;
+
+   // the footer at the very end points back to the end block.  The size
+   // comes from fstat() so the descriptor stays where it was and the
+   // blocks can still be read in turn when the index does not check out
+   if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size < (off_t)(INDEX_FOOTER + BLOCK_PREFIX)) {
+      return HUFF_ERR_READ;
+   }
+   end = info.st_size;
+   if (stats_pread(fd, footer, INDEX_FOOTER, end - INDEX_FOOTER) != INDEX_FOOTER ||
+         footer[8] != 0x4C || footer[9] != 0x70 || footer[10] != 0xF0 || footer[11] != 0x7F) {
+      return HUFF_ERR_CORRUPT;
+   }
+   start = get_number64(footer);
+
+   // the end block gives the number of blocks, its size must match the file
+   if (start + BLOCK_PREFIX > end || stats_pread(fd, prefix, BLOCK_PREFIX, start) != BLOCK_PREFIX || prefix[0] != BLOCK_END) {
+      return HUFF_ERR_CORRUPT;
+   }
+   index->end = start;
+   index->count = get_number(prefix + 1);
+   if (get_number(prefix + 5) != index->count * INDEX_ENTRY + INDEX_FOOTER ||
+         start + BLOCK_PREFIX + get_number(prefix + 5) != end) {
+      index->count = 0;
+      return HUFF_ERR_CORRUPT;
+   }
+
+   if ((index->entries = (struct index_entry *)malloc((index->count + 1) * sizeof(struct index_entry))) == NULL) {
+      index->count = 0;
+      return HUFF_ERR_MEMORY;
+   }
+   index->cap = index->count + 1;
+
+   for (i = 0; i < index->count; i++) {
+      if (stats_pread(fd, entry, INDEX_ENTRY, start + BLOCK_PREFIX + i * INDEX_ENTRY) != INDEX_ENTRY) {
+         break;
+      }
+      index->entries[i].offset = get_number64(entry);
+      index->entries[i].raw_offset = get_number64(entry + 8);
+      if (index->entries[i].offset >= start) {
+         break;
+      }
+   }
+
+   // a partial index is no index
+   if (i < index->count) {
+      free(index->entries);
+      index->entries = NULL;
+      index->count = 0;
+      index->cap = 0;
+      return HUFF_ERR_CORRUPT;
+   }
+
+   return HUFF_OK;
+}
+
+void init_push(struct huff_push *push) {
+   memset(push, 0, sizeof(*push));
+   push->state = PUSH_MAGIC;
+   push->ret = HUFF_OK;
+   init_decode_table(&push->table);
+
+   return;
+}
+
+int push_stream(struct huff_push *push, const unsigned char *in, unsigned long len, unsigned long *used,
+      unsigned char *out, unsigned long cap, unsigned long *written) {
+
+   // variable declarations
+   const unsigned char *p = in, *end = in + len, *block = NULL;
+   unsigned char entry[INDEX_ENTRY];
+   unsigned long num = 0, done = 0;
+   int ret = HUFF_OK;
+
+   while (ret == HUFF_OK && push->state != PUSH_DONE && push->state != PUSH_FAILED) {
+      if (push->state == PUSH_OUTPUT) {
+         // the characters of the last block the caller has not had yet
+         num = (push->out_len - push->out_pos < cap - done) ? push->out_len - push->out_pos : cap - done;
+         memcpy(out + done, push->out + push->out_pos, num);
+         push->out_pos += num;
+         done += num;
+         if (push->out_pos < push->out_len) {
+            ret = HUFF_OUTPUT_FULL;
+         } else {
+            push->state = PUSH_PREFIX;
+         }
+      } else if (push->state == PUSH_MAGIC) {
+         if (!gather_head(push, 5, &p, end)) {
+            ret = HUFF_NEED_INPUT;
+         } else if (push->head[0] != 0x4C || push->head[1] != 0x70 || push->head[2] != 0xF0 || push->head[3] != 0x7E ||
+               (push->head[4] & ~STREAM_CHECKSUM) != 0) {
+            ret = HUFF_ERR_CORRUPT;
+         } else {
+            push->flags = push->head[4];
+            push->offset = 5;
+            push->have = 0;
+            push->state = PUSH_PREFIX;
+         }
+      } else if (push->state == PUSH_PREFIX) {
+         if (!gather_head(push, BLOCK_PREFIX, &p, end)) {
+            ret = HUFF_NEED_INPUT;
+         } else if ((ret = read_block_prefix(push->head, &push->type, &push->raw_len, &push->size)) == HUFF_OK) {
+            push->have = 0;
+            push->state = PUSH_BLOCK;
+
+            // the index is not kept, only a CRC32C of the entries the blocks
+            // call for, to hold the index behind the end block against as it
+            // passes.  The footer after it must point back to the end block
+            if (push->type == BLOCK_END) {
+               if (push->raw_len != push->blocks || push->size != push->raw_len * INDEX_ENTRY + INDEX_FOOTER) {
+                  ret = HUFF_ERR_CORRUPT;
+               }
+               push->end = push->offset;
+               push->skip = push->size - INDEX_FOOTER;
+               push->state = PUSH_INDEX;
+            } else {
+               put_number64(entry, push->offset);
+               put_number64(entry + 8, push->raw_offset);
+               push->index_crc = crc32c(push->index_crc, entry, INDEX_ENTRY);
+               push->offset += BLOCK_PREFIX + push->size;
+               push->raw_offset += push->raw_len;
+               push->blocks++;
+            }
+         }
+      } else if (push->state == PUSH_BLOCK) {
+         // a block that came whole is decoded where it is, one that comes
+         // in pieces is gathered first
+         if (push->have == 0 && (unsigned long)(end - p) >= push->size) {
+            block = p;
+            p += push->size;
+         } else if ((ret = grow_buffer(&push->in, &push->in_cap, push->size)) == HUFF_OK) {
+            num = (push->size - push->have < (unsigned long)(end - p)) ? push->size - push->have : (unsigned long)(end - p);
+            memcpy(push->in + push->have, p, num);
+            push->have += num;
+            p += num;
+            block = push->in;
+            ret = (push->have < push->size) ? HUFF_NEED_INPUT : HUFF_OK;
+         }
+
+         // straight into the caller's buffer when the characters fit,
+         // otherwise handed out from the decoder's
+         if (ret == HUFF_OK && cap - done >= push->raw_len) {
+            ret = decompress_block(push->type, block, push->size, out + done, push->raw_len, &push->table, push->flags & STREAM_CHECKSUM);
+            done += (ret == HUFF_OK) ? push->raw_len : 0;
+            push->have = 0;
+            push->state = PUSH_PREFIX;
+         } else if (ret == HUFF_OK && (ret = grow_buffer(&push->out, &push->out_cap, push->raw_len)) == HUFF_OK) {
+            ret = decompress_block(push->type, block, push->size, push->out, push->raw_len, &push->table, push->flags & STREAM_CHECKSUM);
+            push->out_pos = 0;
+            push->out_len = push->raw_len;
+            push->have = 0;
+            push->state = PUSH_OUTPUT;
+         }
+      } else if (push->state == PUSH_INDEX) {
+         num = (push->skip < (unsigned long long)(end - p)) ? push->skip : (unsigned long)(end - p);
+         push->seen_crc = crc32c(push->seen_crc, p, num);
+         p += num;
+         push->skip -= num;
+         if (push->skip > 0) {
+            ret = HUFF_NEED_INPUT;
+         } else if (push->seen_crc != push->index_crc) {
+            ret = HUFF_ERR_CORRUPT;
+         } else {
+            push->state = PUSH_FOOTER;
+         }
+      } else {
+         if (!gather_head(push, INDEX_FOOTER, &p, end)) {
+            ret = HUFF_NEED_INPUT;
+         } else if (get_number64(push->head) != push->end ||
+               push->head[8] != 0x4C || push->head[9] != 0x70 || push->head[10] != 0xF0 || push->head[11] != 0x7F) {
+            ret = HUFF_ERR_CORRUPT;
+         } else {
+            push->state = PUSH_DONE;
+         }
+      }
+   }
+
+   // an error stops the decoder for good, anything after the footer is
+   // left for the caller
+   if (ret < 0) {
+      push->state = PUSH_FAILED;
+      push->ret = ret;
+   }
+   *used = p - in;
+   *written = done;
+
+   return (push->state == PUSH_FAILED) ? push->ret : ret;
+}
+
+void free_push(struct huff_push *push) {
+   free(push->in);
+   free(push->out);
+   free_decode_table(&push->table);
+   push->in = NULL;
+   push->out = NULL;
+
+   return;
+}
+
+static void put_number(unsigned char *p, unsigned long num) {
+   p[0] = (unsigned char)(num >> 24);
+   p[1] = (unsigned char)(num >> 16);
+   p[2] = (unsigned char)(num >> 8);
+   p[3] = (unsigned char)num;
+
+   return;
+}
+
+static unsigned long get_number(const unsigned char *p) {
+   return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) | ((unsigned long)p[2] << 8) | p[3];
+}
+
+static long read_full(int fd, unsigned char *buf, unsigned long len) {
+   // variable declarations
+   unsigned long done = 0;
+   long ret = 0;
+
+   // pipes hand back whatever is available, keep reading until the request is met
+   while (done < len) {
+      if ((ret = stats_read(fd, buf + done, len - done)) < 0) {
+         return -1;
+      }
+      if (ret == 0) {
+         break;
+      }
+      done += ret;
+   }
+
+   return done;
+}
+
+static void put_number64(unsigned char *p, unsigned long long num) {
+   put_number(p, (unsigned long)(num >> 32));
+   put_number(p + 4, (unsigned long)(num & 0xFFFFFFFF));
+
+   return;
+}
+
+static unsigned long long get_number64(const unsigned char *p) {
+   return ((unsigned long long)get_number(p) << 32) | get_number(p + 4);
+}
+
+static int grow_buffer(unsigned char **buf, unsigned long *cap, unsigned long need) {
+   // variable declarations
+   unsigned char *grown = NULL;
+
+   if (need <= *cap && *buf != NULL) {
+      return HUFF_OK;
+   }
+   if ((grown = (unsigned char *)realloc(*buf, need ? need : 1)) == NULL) {
+      return HUFF_ERR_MEMORY;
+   }
+   *buf = grown;
+   *cap = need;
+
+   return HUFF_OK;
+}
+
+static int add_index_entry(struct block_index *index, unsigned long long offset, unsigned long long raw_offset) {
+   // variable declarations
+   struct index_entry *grown = NULL;
+
+   if (index->count == index->cap) {
+      index->cap = (index->cap == 0) ? 64 : index->cap * 2;
+      if ((grown = (struct index_entry *)realloc(index->entries, index->cap * sizeof(struct index_entry))) == NULL) {
+         return HUFF_ERR_MEMORY;
+      }
+      index->entries = grown;
+   }
+   index->entries[index->count].offset = offset;
+   index->entries[index->count].raw_offset = raw_offset;
+   index->count++;
+
+   return HUFF_OK;
+}
+
+static int write_index(struct io_ring *ring, struct block_index *index, unsigned long long end) {
+   // variable declarations
+   unsigned char prefix[BLOCK_PREFIX] = {BLOCK_END}, entry[INDEX_ENTRY], footer[INDEX_FOOTER] = {0};
+   unsigned long i = 0;
+
+   // the end block counts the blocks and covers the index and footer
+   put_number(prefix + 1, index->count);
+   put_number(prefix + 5, index->count * INDEX_ENTRY + INDEX_FOOTER);
+   if (ring_write(ring, prefix, BLOCK_PREFIX) != 0) {
+      return HUFF_ERR_WRITE;
+   }
+
+   for (i = 0; i < index->count; i++) {
+      put_number64(entry, index->entries[i].offset);
+      put_number64(entry + 8, index->entries[i].raw_offset);
+      if (ring_write(ring, entry, INDEX_ENTRY) != 0) {
+         return HUFF_ERR_WRITE;
+      }
+   }
+
+   put_number64(footer, end);
+   footer[8] = 0x4C;
+   footer[9] = 0x70;
+   footer[10] = 0xF0;
+   footer[11] = 0x7F;
+   if (ring_write(ring, footer, INDEX_FOOTER) != 0) {
+      return HUFF_ERR_WRITE;
+   }
+
+   return HUFF_OK;
+}
+
+static unsigned long long code_cost(int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS]) {
+   // variable declarations
+   unsigned long long bits = 0;
+   int i = 0;
+
+   for (i = 0; i < MAX_CHARS; i++) {
+      bits += (unsigned long long)freq[i] * lengths[i];
+   }
+
+   return bits;
+}
+
+static unsigned char *put_table(unsigned char *p, int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS]) {
+   // variable declarations
+   int i = 0, half = 0;
+
+   // the bit vector of the characters used, first character in the high bit
+   memset(p, 0, 32);
+   for (i = 0; i < MAX_CHARS; i++) {
+      if (freq[i] != 0) {
+         p[i / 8] |= 0x80 >> (i % 8);
+      }
+   }
+   p += 32;
+
+   // one 4 bit length per character used, high nibble first
+   for (i = 0; i < MAX_CHARS; i++) {
+      if (freq[i] == 0) {
+         continue;
+      }
+      if (half == 0) {
+         *p = (unsigned char)(lengths[i] << 4);
+      } else {
+         *p++ |= lengths[i];
+      }
+      half = !half;
+   }
+
+   return p + half;
+}
+
+static const unsigned char *get_table(const unsigned char *p, const unsigned char *end,
+      int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS]) {
+
+   // variable declarations
+   int i = 0, half = 0;
+
+   if (end - p < 32) {
+      return NULL;
+   }
+
+   // the characters used and their code lengths
+   for (i = 0; i < MAX_CHARS; i++) {
+      if ((p[i / 8] << (i % 8)) & 0x80) {
+         freq[i] = 1;
+      }
+   }
+   p += 32;
+
+   for (i = 0; i < MAX_CHARS; i++) {
+      if (freq[i] == 0) {
+         continue;
+      }
+      if (p >= end) {
+         return NULL;
+      }
+      lengths[i] = (half == 0) ? (*p >> 4) : (*p++ & 0x0F);
+      half = !half;
+   }
+
+   return p + half;
+}
+
+static long finish_block(const unsigned char *in, unsigned long len, unsigned char *out, unsigned long cap,
+      unsigned char *p, int type, int checksum) {
+
+   // the checksum of the characters closes the block
+   if (checksum) {
+      if (cap - (p - out) < CHECKSUM_SIZE) {
+         return HUFF_ERR_SPACE;
+      }
+      STATS_BEGIN(PHASE_CHECKSUM);
+      put_number(p, crc32c(0, in, len));
+      STATS_END();
+      p += CHECKSUM_SIZE;
+   }
+
+   out[0] = (unsigned char)type;
+   put_number(out + 1, len);
+   put_number(out + 5, (p - out) - BLOCK_PREFIX);
+   STATS_ADD(STAT_BLOCKS, 1);
+   STATS_ADD(STAT_STORED_BLOCKS, type == BLOCK_STORED);
+   STATS_ADD(STAT_RAW_BYTES, len);
+   STATS_ADD(STAT_PACKED_BYTES, p - out);
+
+   return p - out;
+}
+
+static long store_block(const unsigned char *in, unsigned long len, unsigned char *out, unsigned long cap, int checksum) {
+   // BLOCK_BOUND() leaves room for the characters as they are
+   memcpy(out + BLOCK_PREFIX, in, len);
+
+   return finish_block(in, len, out, cap, out + BLOCK_PREFIX + len, BLOCK_STORED, checksum);
+}
+
+static int sample_incompressible(const unsigned char *in, unsigned long len) {
+
+   // variable declarations
+   int freq[MAX_CHARS] = {0}, i = 0;
+   unsigned char lengths[MAX_CHARS] = {0};
+   unsigned long step = len / SAMPLE_PIECES;
+   unsigned long long bits = (unsigned long long)SAMPLE_PIECES * SAMPLE_PIECE * 8;
+
+   // stretches rather than single characters, so the sample sees the
+   // same short runs the codes would; a sample this small can only make
+   // the characters look less even than they are, so it errs towards coding
+   for (i = 0; i < SAMPLE_PIECES; i++) {
+      count_characters(in + i * step, SAMPLE_PIECE, freq);
+   }
+   generate_code_lengths(freq, lengths, CANONICAL_MAX_LEN);
+
+   return code_cost(freq, lengths) + bits / STORE_GAIN >= bits;
+}
+
+static int gather_head(struct huff_push *push, unsigned long need, const unsigned char **p, const unsigned char *end) {
+   // variable declarations
+   unsigned long num = (need - push->have < (unsigned long)(end - *p)) ? need - push->have : (unsigned long)(end - *p);
+
+   memcpy(push->head + push->have, *p, num);
+   push->have += num;
+   *p += num;
+
+   return push->have == need;
+}
+
+static int decode_block(int type, const unsigned char *in, unsigned long size,
+      unsigned char *out, unsigned long raw_len, struct decode_table *table) {
+
+   // variable declarations
+   int freq[MAX_CHARS] = {0}, i = 0, g = 0, groups = 1, bits = 0, streams = 1, context = 0;
+   unsigned char lengths[MAX_CHARS] = {0}, map[MAX_CHARS] = {0};
+   const unsigned char *p = in, *end = in + size, *jump = NULL;
+   unsigned long sizes[4] = {0};
+   unsigned int base[MAX_CONTEXT_GROUPS] = {0}, pick[MAX_CHARS];
+   struct code code_values[MAX_CHARS] = {{-1, 0, 0}};
+   struct huff_tree tree;
+   struct bit_reader br[4];
+
+   // a stored block is the characters themselves
+   if (type == BLOCK_STORED) {
+      if (size != raw_len) {
+         return HUFF_ERR_CORRUPT;
+      }
+      STATS_BEGIN(PHASE_DECODE);
+      memcpy(out, in, raw_len);
+      STATS_END();
+      return HUFF_OK;
+   }
+
+   if (type != BLOCK_HUFFMAN && type != BLOCK_HUFFMAN4 && type != BLOCK_CONTEXT && type != BLOCK_CONTEXT4) {
+      return HUFF_ERR_CORRUPT;
+   }
+   streams = (type == BLOCK_HUFFMAN4 || type == BLOCK_CONTEXT4) ? 4 : 1;
+   context = (type == BLOCK_CONTEXT || type == BLOCK_CONTEXT4);
+
+   // a context block starts with its group count and the group of every
+   // previous character
+   if (context) {
+      if (size < 1 + MAX_CHARS / 2 || (groups = *p++) < 1 || groups > MAX_CONTEXT_GROUPS) {
+         return HUFF_ERR_CORRUPT;
+      }
+      for (i = 0; i < MAX_CHARS; i += 2) {
+         map[i] = *p >> 4;
+         map[i + 1] = *p++ & 0x0F;
+         if (map[i] >= groups || map[i + 1] >= groups) {
+            return HUFF_ERR_CORRUPT;
+         }
+      }
+   }
+
+   // every group's characters and code lengths, each rebuilt into a
+   // primary table of its own in the one entry array
+   table->size = 0;
+   table->max_len = 0;
+   table->single = 0;
+   table->short_codes = 0;
+   table->multi_built = 0;
+   for (g = 0; g < groups; g++) {
+      memset(freq, 0, sizeof(freq));
+      memset(lengths, 0, sizeof(lengths));
+      if ((p = get_table(p, end, freq, lengths)) == NULL) {
+         return HUFF_ERR_CORRUPT;
+      }
+      if (raw_len == 0) {
+         continue;
+      }
+      if (valid_code_lengths(freq, lengths) == 0) {
+         return HUFF_ERR_CORRUPT;
+      }
+      build_canonical_codes(freq, lengths, code_values);
+      if (generate_code_tree(&tree, code_values) != 0) {
+         return HUFF_ERR_CORRUPT;
+      }
+      if (context) {
+         if (add_decode_group(table, &tree, &base[g], &bits) != 0) {
+            return HUFF_ERR_MEMORY;
+         }
+         for (i = 0; i < MAX_CHARS; i++) {
+            if (map[i] == g) {
+               pick[i] = DECODE_PICK(base[g], bits);
+            }
+         }
+      } else if (build_decode_table(table, &tree) != 0) {
+         return HUFF_ERR_MEMORY;
+      }
+   }
+
+   // the four stream payload starts with the sizes of the first three streams
+   if (streams == 4) {
+      if (end - p < JUMP_TABLE) {
+         return HUFF_ERR_CORRUPT;
+      }
+      jump = p;
+      p += JUMP_TABLE;
+      sizes[0] = get_number(jump);
+      sizes[1] = get_number(jump + 4);
+      sizes[2] = get_number(jump + 8);
+      if (sizes[0] + sizes[1] + sizes[2] > (unsigned long)(end - p)) {
+         return HUFF_ERR_CORRUPT;
+      }
+      sizes[3] = (end - p) - sizes[0] - sizes[1] - sizes[2];
+   } else {
+      sizes[0] = end - p;
+   }
+
+   if (raw_len == 0) {
+      return HUFF_OK;
+   }
+
+   // a lone character needs no payload at all
+   if (!context && table->single) {
+      memset(out, tree.nodes[tree.root].ch, raw_len);
+      return HUFF_OK;
+   }
+
+   for (i = 0; i < streams; i++) {
+      init_bit_reader_mem(&br[i], p, sizes[i]);
+      p += sizes[i];
+   }
+   if (context && streams == 4) {
+      decode_symbols_context4(table, pick, br, out, raw_len);
+   } else if (context) {
+      decode_symbols_context(table, pick, &br[0], out, raw_len);
+   } else if (streams == 4) {
+      decode_symbols4(table, br, out, raw_len);
+   } else {
+      decode_symbols(table, &br[0], out, raw_len);
+   }
+
+   // the codes ran past the end of the block, or a stream into the next one
+   for (i = 0; i < streams; i++) {
+      if (bit_reader_overrun(&br[i])) {
+         return HUFF_ERR_CORRUPT;
+      }
+   }
+
+   return HUFF_OK;
+}
+
+static void compress_slot(void *arg) {
+   // variable declarations
+   struct block_slot *slot = (struct block_slot *)arg;
+   long size = compress_block(slot->in, slot->raw_len, slot->out, slot->out_cap, slot->streams, slot->context, slot->checksum, slot->sample);
+
+   slot->ret = (size < 0) ? (int)size : HUFF_OK;
+   slot->size = (size < 0) ? 0 : size;
+
+   return;
+}
+
+static int check_index(struct io_ring *ring, const unsigned char prefix[BLOCK_PREFIX], const struct block_index *seen, unsigned long long end) {
+   // variable declarations
+   unsigned char entry[INDEX_ENTRY], footer[INDEX_FOOTER], extra = 0;
+   unsigned long i = 0;
+
+   // the end block counts the blocks and covers the index and footer
+   if (get_number(prefix + 1) != seen->count || get_number(prefix + 5) != seen->count * INDEX_ENTRY + INDEX_FOOTER) {
+      return HUFF_ERR_CORRUPT;
+   }
+
+   // every entry is where its block was found
+   for (i = 0; i < seen->count; i++) {
+      if (ring_read(ring, entry, INDEX_ENTRY) != INDEX_ENTRY ||
+            get_number64(entry) != seen->entries[i].offset || get_number64(entry + 8) != seen->entries[i].raw_offset) {
+         return HUFF_ERR_CORRUPT;
+      }
+   }
+
+   // the footer points back to the end block and nothing comes after it
+   if (ring_read(ring, footer, INDEX_FOOTER) != INDEX_FOOTER || get_number64(footer) != end ||
+         footer[8] != 0x4C || footer[9] != 0x70 || footer[10] != 0xF0 || footer[11] != 0x7F) {
+      return HUFF_ERR_CORRUPT;
+   }
+   if (ring_read(ring, &extra, 1) != 0) {
+      return HUFF_ERR_CORRUPT;
+   }
+
+   return HUFF_OK;
+}
+
+static void decompress_slot(void *arg) {
+   // variable declarations
+   struct block_slot *slot = (struct block_slot *)arg;
+   unsigned char prefix[BLOCK_PREFIX];
+
+   // an indexed block is read here, by the worker
+   if (slot->fd != -1) {
+      if (stats_pread(slot->fd, prefix, BLOCK_PREFIX, slot->offset) != BLOCK_PREFIX) {
+         slot->ret = HUFF_ERR_CORRUPT;
+         return;
+      }
+      if ((slot->ret = read_block_prefix(prefix, &slot->type, &slot->raw_len, &slot->size)) != HUFF_OK) {
+         return;
+      }
+      if (slot->type == BLOCK_END) {
+         slot->ret = HUFF_ERR_CORRUPT;
+         return;
+      }
+      if ((slot->ret = grow_buffer(&slot->in, &slot->in_cap, slot->size)) != HUFF_OK) {
+         return;
+      }
+      if (stats_pread(slot->fd, slot->in, slot->size, slot->offset + BLOCK_PREFIX) != slot->size) {
+         slot->ret = HUFF_ERR_CORRUPT;
+         return;
+      }
+   }
+
+   if ((slot->ret = grow_buffer(&slot->out, &slot->out_cap, slot->raw_len)) != HUFF_OK) {
+      return;
+   }
+   slot->ret = decompress_block(slot->type, slot->in, slot->size, slot->out, slot->raw_len, &slot->table, slot->checksum);
+
+   return;
+}
@@ -0,0 +1,173 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      The block based stream format.  The input is cut into fixed size
+ *      blocks and every block carries its own code lengths and payload, so
+ *      a stream is compressed in a single pass with memory bounded by the
+ *      block size and can be read from and written to pipes.
+ *
+ *      Stream layout (all numbers most significant byte first):
+ *
+ *         magic number   4 bytes   0x4C 0x70 0xF0 0x7E
+ *         flags          1 byte    STREAM_CHECKSUM or zero
+ *         blocks         ...
+ *
+ *      Every block starts with the same 9 byte prefix:
+ *
+ *         type           1 byte    BLOCK_END, BLOCK_HUFFMAN(4), BLOCK_CONTEXT(4)
+ *                                   or BLOCK_STORED
+ *         characters     4 bytes   characters the block decodes to
+ *         size           4 bytes   bytes of the block after the prefix
+ *
+ *      A BLOCK_HUFFMAN block then holds the 32 byte bit vector of the
+ *      characters used, one 4 bit code length per used character (high
+ *      nibble first) and the canonical code payload.  A BLOCK_HUFFMAN4
+ *      block has the same table but splits its characters into four equal
+ *      segments (the last one takes what is left), each coded as its own
+ *      byte aligned stream.  The payload starts with a jump table of the
+ *      byte sizes of the first three streams (4 bytes each), the fourth
+ *      runs to the end of the block.  The streams can be decoded side by
+ *      side.
+ *
+ *      The BLOCK_CONTEXT and BLOCK_CONTEXT4 blocks code every character with
+ *      a table picked by the character before it (see context_huff.h).  In
+ *      place of the one table they hold the number of tables (1 to 16), the
+ *      table of every previous character as 4 bit numbers (128 bytes, high
+ *      nibble first) and then the tables one after the other in the same
+ *      form as above.  The payloads are laid out as in BLOCK_HUFFMAN and
+ *      BLOCK_HUFFMAN4, the first character of every stream is coded as if
+ *      it followed a zero.
+ *
+ *      A BLOCK_STORED block holds the characters as they are, its size is
+ *      its character count.  The compressor estimates a block's coded size
+ *      from its histogram and code lengths before coding it and stores the
+ *      block when the codes would not save at least 1/STORE_GAIN of it, so
+ *      random or already compressed input costs a memcpy() both ways
+ *      instead of a slower pass that saves next to nothing.  With sampling
+ *      turned on a few short stretches of the block are counted first and
+ *      a block that looks incompressible from them is stored without the
+ *      histogram of the whole block.
+ *
+ *      With STREAM_CHECKSUM in the flags every block other than the end
+ *      block ends in the CRC32C of the characters it decodes to (4 bytes,
+ *      counted in its size), so damage the codes do not catch still shows
+ *      and a block can be checked on its own (see crc_huff.h).
+ *
+ *      The BLOCK_END block ends the stream.  Its character count is the
+ *      number of blocks and it is followed by the block index, so readers
+ *      that can seek may hand the blocks to threads:
+ *
+ *         entries        16 bytes each, the block's offset in the stream
+ *                        and the offset of its first character (8 bytes each)
+ *         footer         8 bytes offset of the BLOCK_END block and the
+ *                        4 bytes 0x4C 0x70 0xF0 0x7F
+ *
+ *      Blocks need not all be the same size.  With a split level the
+ *      compressor cuts a block short where the character statistics change
+ *      enough that a new table pays for its own header (split_point()).
+ *
+ *      The block starts in the index are the stream's sync points: every
+ *      block has its own table and byte aligned payload, so a range of the
+ *      original is decoded by looking up the last block starting at or
+ *      before it and decoding forward from there (decompress_range()).
+ *      The block size sets how far apart the sync points are.
+ *
+ *      The same layout is produced and read in memory by compress_buffer()
+ *      and decompress_buffer(), which is what the huff.h library calls use.
+ *      push_stream() reads it from pieces of any size as they come, keeping
+ *      a block that is split between them until the rest arrives.  It does
+ *      not keep the index, the entries are checked as they pass against a
+ *      CRC32C of the ones the blocks call for.
+ *
+ ***************************/
+
+#ifndef HUFFMAN_BLOCK
+#define HUFFMAN_BLOCK
+
+#include <stdio.h>
+
+#include "huff.h"
+#include "tree_huff.h"
+#include "decode_huff.h"
+#include "crc_huff.h"
+
+#define BLOCK_END      0
+#define BLOCK_HUFFMAN  1
+#define BLOCK_HUFFMAN4 2
+#define BLOCK_CONTEXT  3
+#define BLOCK_CONTEXT4 4
+#define BLOCK_STORED   5
+
+#define STREAM_CHECKSUM 0x01
+
+#define BLOCK_PREFIX       9
+#define INDEX_ENTRY        16
+#define INDEX_FOOTER       12
+#define JUMP_TABLE         12
+#define BLOCK_TABLE_MAX    (32 + MAX_CHARS / 2)
+#define DEFAULT_BLOCK_SIZE (1 << 20)
+#define MIN_BLOCK_SIZE     (1 << 12)
+#define MAX_BLOCK_SIZE     (1 << 22)
+#define MAX_SPLIT_LEVEL    4
+
+// a block is coded only when that saves at least 1/STORE_GAIN of it
+#define STORE_GAIN         32
+
+// the sampling pre-check counts SAMPLE_PIECES stretches of SAMPLE_PIECE
+// characters spread evenly over blocks of at least SAMPLE_MIN characters
+#define SAMPLE_PIECES      16
+#define SAMPLE_PIECE       256
+#define SAMPLE_MIN         (4 * SAMPLE_PIECES * SAMPLE_PIECE)
+
+// the statistics of a block are compared a window at a time, higher
+// levels look at smaller windows (down to MIN_BLOCK_SIZE)
+#define SPLIT_WINDOW(level) ((unsigned long)MIN_BLOCK_SIZE << (MAX_SPLIT_LEVEL - (level)))
+
+// the shortest block the splitter can leave behind
+#define SPLIT_UNIT(block_size, level) \
+   (((level) > 0 && SPLIT_WINDOW(level) < (block_size)) ? SPLIT_WINDOW(level) : (unsigned long)(block_size))
+
+// largest a block of len characters can get, with room for its four
+// streams to be coded apart before they are moved together
+#define BLOCK_BOUND(len) (BLOCK_PREFIX + BLOCK_TABLE_MAX + JUMP_TABLE + ((unsigned long)(len) * CANONICAL_MAX_LEN + 7) / 8 + 80 + CHECKSUM_SIZE)
+
+// largest a whole stream of len characters in block_size blocks can get
+#define STREAM_BOUND(len, block_size) (5 + BLOCK_PREFIX + INDEX_FOOTER + \
+   ((unsigned long)(len) / (block_size) + 1) * (BLOCK_BOUND(0) + 1 + INDEX_ENTRY) + \
+   (unsigned long)(len) * CANONICAL_MAX_LEN / 8)
+
+struct index_entry {
+   unsigned long long offset;       // where the block starts in the stream
+   unsigned long long raw_offset;   // where its characters start in the original
+};
+
+struct block_index {
+   struct index_entry *entries;
+   unsigned long count;
+   unsigned long cap;
+   unsigned long long end;          // where the end block starts, set by read_index()
+};
+
+// function prototypes
+long compress_block(const unsigned char *in, unsigned long len, unsigned char *out, unsigned long cap, int streams, int context, int checksum, int sample);
+int  read_block_prefix(const unsigned char prefix[BLOCK_PREFIX], int *type, unsigned long *raw_len, unsigned long *size);
+int  decompress_block(int type, const unsigned char *in, unsigned long size, unsigned char *out, unsigned long raw_len, struct decode_table *table, int checksum);
+unsigned long split_point(const unsigned char *in, unsigned long len, int level, int streams, int checksum);
+int  compress_stream(int fd_in, int fd_out, unsigned long block_size, int threads, int streams, int split, int context, int checksum, int sample);
+int  decompress_stream(int fd, int fd_out, int threads);
+int  decompress_range(int fd, FILE *file_out, unsigned long long start, unsigned long long len);
+long compress_buffer(const unsigned char *in, unsigned long len, unsigned char *out, unsigned long cap, unsigned long block_size, int streams, int split, int context, int checksum, int sample);
+long decompress_buffer(const unsigned char *in, unsigned long len, unsigned char *out, unsigned long cap, struct decode_table *table);
+long decompress_range_buffer(const unsigned char *in, unsigned long len, unsigned long long start, unsigned char *out, unsigned long count,
+      struct decode_table *table, unsigned char **scratch, unsigned long *scratch_cap);
+long stream_raw_size(const unsigned char *in, unsigned long len);
+void init_push(struct huff_push *push);
+int  push_stream(struct huff_push *push, const unsigned char *in, unsigned long len, unsigned long *used,
+      unsigned char *out, unsigned long cap, unsigned long *written);
+void free_push(struct huff_push *push);
+int  read_index(int fd, struct block_index *index);
+
+#endif //HUFFMAN_BLOCK
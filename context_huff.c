@@ -0,0 +1,309 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      This file is the implementation code for the order-1 context model
+ *      (see context_huff.h).  The counts of every character after every
+ *      previous character are gathered first, all of the clustering then
+ *      works on those counts and the code lengths from tree_huff.c.
+ *
+ ***************************/
+
+#include <stdlib.h>  // malloc(), free()
+#include <string.h>  // memset(), memcpy()
+
+#include "context_huff.h"
+
+// the counts the clustering works from
+struct context_counts {
+   int freq[MAX_CHARS][MAX_CHARS];          // character counts after each previous character
+   unsigned char used[MAX_CHARS][MAX_CHARS];   // the characters seen after it
+   int num_used[MAX_CHARS];
+   unsigned long total[MAX_CHARS];
+   int all[MAX_CHARS];                         // the plain character counts
+};
+
+// function prototypes
+static void count_contexts(const unsigned char *in, unsigned long len, unsigned long seg, struct context_counts *counts);
+static unsigned long long group_cost(int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS]);
+static unsigned long long table_bits(int freq[MAX_CHARS]);
+static void sum_groups(struct context_counts *counts, const int active[MAX_CHARS], int num_active, struct context_model *model);
+
+int build_context_model(const unsigned char *in, unsigned long len, unsigned long seg, struct context_model *model) {
+
+   // variable declarations
+   struct context_counts *counts = NULL;
+   int active[MAX_CHARS], num_active = 0, present[MAX_CHARS] = {0}, smooth[MAX_CHARS];
+   int merged[MAX_CHARS], i = 0, j = 0, g = 0, s = 0, best = 0, pass = 0, changed = 0, a = 0, b = 0, last = 0;
+   unsigned char model_lengths[MAX_CONTEXT_GROUPS][MAX_CHARS], lengths[MAX_CHARS];
+   unsigned long long cost[MAX_CONTEXT_GROUPS], pair[MAX_CONTEXT_GROUPS][MAX_CONTEXT_GROUPS];
+   unsigned long long bits = 0, best_bits = 0;
+   long long saving = 0, best_saving = 0;
+   int remap[MAX_CONTEXT_GROUPS];
+
+   if ((counts = (struct context_counts *)malloc(sizeof(struct context_counts))) == NULL) {
+      return -1;
+   }
+   count_contexts(in, len, seg, counts);
+
+   // the contexts that occur, busiest first
+   for (i = 0; i < MAX_CHARS; i++) {
+      if (counts->total[i] == 0) {
+         continue;
+      }
+      for (j = num_active; j > 0 && counts->total[active[j - 1]] < counts->total[i]; j--) {
+         active[j] = active[j - 1];
+      }
+      active[j] = i;
+      num_active++;
+      for (s = 0; s < counts->num_used[i]; s++) {
+         present[counts->used[i][s]] = 1;
+      }
+   }
+
+   // the busiest contexts each start a group, the rest start in the first
+   memset(model->map, 0, sizeof(model->map));
+   model->groups = (num_active < MAX_CONTEXT_GROUPS) ? num_active : MAX_CONTEXT_GROUPS;
+   for (g = 0; g < model->groups; g++) {
+      model->map[active[g]] = (unsigned char)g;
+   }
+
+   // move every context to the group that codes it in the fewest bits.  A
+   // group is priced as if it had seen every character of the block once,
+   // so a context can be tried against a group missing some of its characters
+   for (pass = 0; pass < CONTEXT_PASSES && model->groups > 1; pass++) {
+      sum_groups(counts, active, num_active, model);
+      for (g = 0; g < model->groups; g++) {
+         for (s = 0; s < MAX_CHARS; s++) {
+            smooth[s] = model->freq[g][s] + present[s];
+         }
+         generate_code_lengths(smooth, model_lengths[g], CANONICAL_MAX_LEN);
+      }
+
+      changed = 0;
+      for (i = 0; i < num_active; i++) {
+         best = model->map[active[i]];
+         best_bits = ~0ULL;
+         for (g = 0; g < model->groups; g++) {
+            bits = 0;
+            for (s = 0; s < counts->num_used[active[i]]; s++) {
+               j = counts->used[active[i]][s];
+               bits += (unsigned long long)counts->freq[active[i]][j] * model_lengths[g][j];
+            }
+            if (bits < best_bits) {
+               best_bits = bits;
+               best = g;
+            }
+         }
+         changed += (best != model->map[active[i]]);
+         model->map[active[i]] = (unsigned char)best;
+      }
+      if (changed == 0) {
+         break;
+      }
+   }
+
+   // the groups left empty are dropped
+   sum_groups(counts, active, num_active, model);
+   for (g = 0, j = 0; g < model->groups; g++) {
+      remap[g] = j;
+      for (s = 0; s < MAX_CHARS && model->freq[g][s] == 0; s++) {
+      }
+      if (s < MAX_CHARS) {
+         memcpy(model->freq[j], model->freq[g], sizeof(model->freq[j]));
+         j++;
+      }
+   }
+
+   // characters never followed by anything can point at any group
+   for (i = 0; i < MAX_CHARS; i++) {
+      model->map[i] = (counts->total[i] != 0) ? (unsigned char)remap[model->map[i]] : 0;
+   }
+   model->groups = j;
+
+   // the real tables.  Merging groups never shortens the payload, so when
+   // these tables do not save enough over one table to pay for the map and
+   // a second table, nothing the merging finds will either
+   for (a = 0, bits = 0; a < model->groups; a++) {
+      generate_code_lengths(model->freq[a], model->lengths[a], CANONICAL_MAX_LEN);
+      cost[a] = group_cost(model->freq[a], model->lengths[a]) + table_bits(model->freq[a]);
+      bits += group_cost(model->freq[a], model->lengths[a]);
+   }
+   generate_code_lengths(counts->all, lengths, CANONICAL_MAX_LEN);
+   if (group_cost(counts->all, lengths) < bits + 8 * (1 + MAX_CHARS / 2 + 32)) {
+      memset(model->map, 0, sizeof(model->map));
+      memcpy(model->freq[0], counts->all, sizeof(model->freq[0]));
+      model->groups = 1;
+   }
+   for (a = 0; a < model->groups; a++) {
+      for (b = a + 1; b < model->groups; b++) {
+         for (s = 0; s < MAX_CHARS; s++) {
+            merged[s] = model->freq[a][s] + model->freq[b][s];
+         }
+         generate_code_lengths(merged, lengths, CANONICAL_MAX_LEN);
+         pair[a][b] = group_cost(merged, lengths) + table_bits(merged);
+      }
+   }
+
+   // merge the pair that saves the most until no merge saves anything
+   while (model->groups > 1) {
+      best_saving = 0;
+      for (i = 0; i < model->groups; i++) {
+         for (j = i + 1; j < model->groups; j++) {
+            saving = (long long)(cost[i] + cost[j]) - (long long)pair[i][j];
+            if (saving > best_saving) {
+               best_saving = saving;
+               a = i;
+               b = j;
+            }
+         }
+      }
+      if (best_saving == 0) {
+         break;
+      }
+
+      // b joins a, the last group moves into b's place
+      last = model->groups - 1;
+      for (s = 0; s < MAX_CHARS; s++) {
+         model->freq[a][s] += model->freq[b][s];
+      }
+      cost[a] = pair[a][b];
+      for (i = 0; i < MAX_CHARS; i++) {
+         if (model->map[i] == b) {
+            model->map[i] = (unsigned char)a;
+         } else if (model->map[i] == last) {
+            model->map[i] = (unsigned char)b;
+         }
+      }
+      if (b != last) {
+         memcpy(model->freq[b], model->freq[last], sizeof(model->freq[b]));
+         cost[b] = cost[last];
+         for (i = 0; i < last; i++) {
+            if (i < b) {
+               pair[i][b] = pair[i][last];
+            } else if (i > b) {
+               pair[b][i] = pair[i][last];
+            }
+         }
+      }
+      model->groups--;
+
+      // only the pairs with the grown group need pricing again
+      for (i = 0; i < model->groups; i++) {
+         if (i == a) {
+            continue;
+         }
+         for (s = 0; s < MAX_CHARS; s++) {
+            merged[s] = model->freq[a][s] + model->freq[i][s];
+         }
+         generate_code_lengths(merged, lengths, CANONICAL_MAX_LEN);
+         if (i < a) {
+            pair[i][a] = group_cost(merged, lengths) + table_bits(merged);
+         } else {
+            pair[a][i] = group_cost(merged, lengths) + table_bits(merged);
+         }
+      }
+   }
+
+   model->bits = 0;
+   for (g = 0; g < model->groups; g++) {
+      generate_code_lengths(model->freq[g], model->lengths[g], CANONICAL_MAX_LEN);
+      model->bits += group_cost(model->freq[g], model->lengths[g]);
+   }
+
+   free(counts);
+
+   return 0;
+}
+
+unsigned long context_header_size(const struct context_model *model) {
+   // variable declarations
+   unsigned long size = 1 + MAX_CHARS / 2;
+   int g = 0, s = 0, used = 0;
+
+   // the group count, the map of 4 bit group numbers and every group's table
+   for (g = 0; g < model->groups; g++) {
+      used = 0;
+      for (s = 0; s < MAX_CHARS; s++) {
+         used += (model->freq[g][s] != 0);
+      }
+      size += 32 + (used + 1) / 2;
+   }
+
+   return size;
+}
+
+static void count_contexts(const unsigned char *in, unsigned long len, unsigned long seg, struct context_counts *counts) {
+   // variable declarations
+   unsigned long start = 0, end = 0, i = 0;
+   int prev = 0, c = 0, s = 0;
+
+   memset(counts->freq, 0, sizeof(counts->freq));
+   memset(counts->total, 0, sizeof(counts->total));
+   memset(counts->all, 0, sizeof(counts->all));
+
+   // the first character of every segment is taken to follow a zero
+   for (start = 0; start < len; start = end) {
+      end = (len - start < seg) ? len : start + seg;
+      prev = 0;
+      for (i = start; i < end; i++) {
+         counts->freq[prev][in[i]]++;
+         prev = in[i];
+      }
+   }
+
+   // the characters seen after every context, so the pricing can skip the rest
+   for (c = 0; c < MAX_CHARS; c++) {
+      counts->num_used[c] = 0;
+      for (s = 0; s < MAX_CHARS; s++) {
+         if (counts->freq[c][s] != 0) {
+            counts->used[c][counts->num_used[c]++] = (unsigned char)s;
+            counts->total[c] += counts->freq[c][s];
+            counts->all[s] += counts->freq[c][s];
+         }
+      }
+   }
+
+   return;
+}
+
+static unsigned long long group_cost(int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS]) {
+   // variable declarations
+   unsigned long long bits = 0;
+   int s = 0;
+
+   for (s = 0; s < MAX_CHARS; s++) {
+      bits += (unsigned long long)freq[s] * lengths[s];
+   }
+
+   return bits;
+}
+
+static unsigned long long table_bits(int freq[MAX_CHARS]) {
+   // variable declarations
+   int s = 0, used = 0;
+
+   for (s = 0; s < MAX_CHARS; s++) {
+      used += (freq[s] != 0);
+   }
+
+   // the bit vector and a 4 bit length per character used
+   return 8 * 32 + 4 * used;
+}
+
+static void sum_groups(struct context_counts *counts, const int active[MAX_CHARS], int num_active, struct context_model *model) {
+   // variable declarations
+   int i = 0, s = 0, g = 0;
+
+   memset(model->freq, 0, sizeof(model->freq));
+   for (i = 0; i < num_active; i++) {
+      g = model->map[active[i]];
+      for (s = 0; s < counts->num_used[active[i]]; s++) {
+         model->freq[g][counts->used[active[i]][s]] += counts->freq[active[i]][counts->used[active[i]][s]];
+      }
+   }
+
+   return;
+}
@@ -0,0 +1,38 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      Order-1 context modelling for the stream format.  Every character is
+ *      coded with a table picked by the character before it.  A table for
+ *      each of the 256 previous characters would cost more header than it
+ *      saves, so the previous characters are clustered into at most
+ *      MAX_CONTEXT_GROUPS groups that share a table.  The groups are found
+ *      with a few rounds of moving every context to the group whose table
+ *      codes its characters best, then groups are merged for as long as a
+ *      merge saves more header than it costs payload.
+ *
+ ***************************/
+
+#ifndef HUFFMAN_CONTEXT
+#define HUFFMAN_CONTEXT
+
+#include "tree_huff.h"
+
+#define MAX_CONTEXT_GROUPS 16
+#define CONTEXT_PASSES     4
+
+struct context_model {
+   unsigned char map[MAX_CHARS];                       // group of every previous character
+   int groups;
+   int freq[MAX_CONTEXT_GROUPS][MAX_CHARS];
+   unsigned char lengths[MAX_CONTEXT_GROUPS][MAX_CHARS];
+   unsigned long long bits;                            // payload size coded with the group tables
+};
+
+// function prototypes
+int  build_context_model(const unsigned char *in, unsigned long len, unsigned long seg, struct context_model *model);
+unsigned long context_header_size(const struct context_model *model);
+
+#endif //HUFFMAN_CONTEXT
@@ -0,0 +1,216 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      This file is the implementation code for the block checksums (see
+ *      crc_huff.h).  The table driven CRC works on eight bytes a step with
+ *      eight tables (slicing by 8).  The crc32 instruction takes three
+ *      cycles but can start one every cycle, so the hardware CRC runs three
+ *      independent lanes over adjacent stretches of the buffer and then
+ *      joins them: the CRC of the first lane is moved past the bytes of
+ *      the next one with a table of the effect of that many zero bytes,
+ *      which is all joining two CRCs takes.
+ *
+ ***************************/
+
+#include <string.h>   // memcpy()
+#include <pthread.h>  // pthread_once()
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>  // _mm_crc32_u8(), _mm_crc32_u64()
+#endif
+
+#include "crc_huff.h"
+
+#define CRC32C_POLY 0x82F63B78u   // reflected
+#define CRC_LONG    8192          // bytes per lane of the long hardware rounds
+#define CRC_SHORT   256           // and of the short ones for what is left
+
+// the eight slicing tables and the moves past a lane of zeros
+static unsigned int crc_table[8][256];
+static unsigned int crc_long[4][256];
+static unsigned int crc_short[4][256];
+
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+static unsigned int (*crc_func)(unsigned int crc, const unsigned char *buf, unsigned long len);
+
+// function prototypes
+static void crc_init(void);
+static unsigned int crc_software(unsigned int crc, const unsigned char *buf, unsigned long len);
+static unsigned int gf2_times(const unsigned int mat[32], unsigned int vec);
+static void gf2_square(unsigned int square[32], const unsigned int mat[32]);
+static void zeros_table(unsigned int table[4][256], unsigned long len);
+#if defined(__x86_64__)
+static unsigned int crc_hardware(unsigned int crc, const unsigned char *buf, unsigned long len);
+#endif
+
+unsigned int crc32c(unsigned int crc, const unsigned char *buf, unsigned long len) {
+   pthread_once(&crc_once, crc_init);
+
+   // the register starts and ends inverted, so a CRC can be carried on
+   return ~crc_func(~crc, buf, len);
+}
+
+int crc32c_hardware(void) {
+   pthread_once(&crc_once, crc_init);
+
+   return crc_func != crc_software;
+}
+
+static void crc_init(void) {
+   // variable declarations
+   unsigned int crc = 0;
+   int i = 0, k = 0;
+
+   for (i = 0; i < 256; i++) {
+      crc = i;
+      for (k = 0; k < 8; k++) {
+         crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+      }
+      crc_table[0][i] = crc;
+   }
+
+   // table k moves the CRC of a byte past k more zero bytes
+   for (i = 0; i < 256; i++) {
+      crc = crc_table[0][i];
+      for (k = 1; k < 8; k++) {
+         crc = crc_table[0][crc & 0xFF] ^ (crc >> 8);
+         crc_table[k][i] = crc;
+      }
+   }
+
+   crc_func = crc_software;
+#if defined(__x86_64__)
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("sse4.2")) {
+      zeros_table(crc_long, CRC_LONG);
+      zeros_table(crc_short, CRC_SHORT);
+      crc_func = crc_hardware;
+   }
+#endif
+
+   return;
+}
+
+static unsigned int crc_software(unsigned int crc, const unsigned char *buf, unsigned long len) {
+   // the bytes are put together one at a time so the order in memory does not matter
+   while (len >= 8) {
+      crc ^= (unsigned int)buf[0] | ((unsigned int)buf[1] << 8) | ((unsigned int)buf[2] << 16) | ((unsigned int)buf[3] << 24);
+      crc = crc_table[7][crc & 0xFF] ^ crc_table[6][(crc >> 8) & 0xFF] ^ crc_table[5][(crc >> 16) & 0xFF] ^ crc_table[4][crc >> 24] ^
+            crc_table[3][buf[4]] ^ crc_table[2][buf[5]] ^ crc_table[1][buf[6]] ^ crc_table[0][buf[7]];
+      buf += 8;
+      len -= 8;
+   }
+   while (len > 0) {
+      crc = crc_table[0][(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+      len--;
+   }
+
+   return crc;
+}
+
+#if defined(__x86_64__)
+// lane is CRC_LONG or CRC_SHORT, table the matching move past its zeros
+#define CRC_ROUNDS(lane, table) \
+   while (len >= 3 * (lane)) { \
+      crc1 = 0; \
+      crc2 = 0; \
+      for (end = buf + (lane); buf < end; buf += 8) { \
+         memcpy(&word0, buf, 8); \
+         memcpy(&word1, buf + (lane), 8); \
+         memcpy(&word2, buf + 2 * (lane), 8); \
+         crc0 = _mm_crc32_u64(crc0, word0); \
+         crc1 = _mm_crc32_u64(crc1, word1); \
+         crc2 = _mm_crc32_u64(crc2, word2); \
+      } \
+      crc0 = (table)[0][crc0 & 0xFF] ^ (table)[1][(crc0 >> 8) & 0xFF] ^ (table)[2][(crc0 >> 16) & 0xFF] ^ (table)[3][crc0 >> 24] ^ crc1; \
+      crc0 = (table)[0][crc0 & 0xFF] ^ (table)[1][(crc0 >> 8) & 0xFF] ^ (table)[2][(crc0 >> 16) & 0xFF] ^ (table)[3][crc0 >> 24] ^ crc2; \
+      buf += 2 * (lane); \
+      len -= 3 * (lane); \
+   }
+
+__attribute__((target("sse4.2")))
+static unsigned int crc_hardware(unsigned int crc, const unsigned char *buf, unsigned long len) {
+   // variable declarations
+   unsigned long long crc0 = crc, crc1 = 0, crc2 = 0, word0 = 0, word1 = 0, word2 = 0;
+   const unsigned char *end = NULL;
+
+   // up to an eight byte boundary a byte at a time
+   while (len > 0 && ((unsigned long)buf & 7) != 0) {
+      crc0 = _mm_crc32_u8(crc0, *buf++);
+      len--;
+   }
+
+   CRC_ROUNDS(CRC_LONG, crc_long);
+   CRC_ROUNDS(CRC_SHORT, crc_short);
+
+   // the rest in one lane
+   while (len >= 8) {
+      memcpy(&word0, buf, 8);
+      crc0 = _mm_crc32_u64(crc0, word0);
+      buf += 8;
+      len -= 8;
+   }
+   while (len > 0) {
+      crc0 = _mm_crc32_u8(crc0, *buf++);
+      len--;
+   }
+
+   return (unsigned int)crc0;
+}
+#endif
+
+static unsigned int gf2_times(const unsigned int mat[32], unsigned int vec) {
+   // variable declarations
+   unsigned int sum = 0;
+   int i = 0;
+
+   for (i = 0; vec != 0; i++, vec >>= 1) {
+      if (vec & 1) {
+         sum ^= mat[i];
+      }
+   }
+
+   return sum;
+}
+
+static void gf2_square(unsigned int square[32], const unsigned int mat[32]) {
+   // variable declarations
+   int i = 0;
+
+   for (i = 0; i < 32; i++) {
+      square[i] = gf2_times(mat, mat[i]);
+   }
+
+   return;
+}
+
+static void zeros_table(unsigned int table[4][256], unsigned long len) {
+   // variable declarations
+   unsigned int op[32], tmp[32], row = 1;
+   unsigned long bits = 1;
+   int i = 0, k = 0;
+
+   // the CRC register moved past one zero bit, then squared until it
+   // moves past len zero bytes (len is a power of two)
+   op[0] = CRC32C_POLY;
+   for (i = 1; i < 32; i++) {
+      op[i] = row;
+      row <<= 1;
+   }
+   for (bits = 1; bits < 8 * len; bits *= 2) {
+      gf2_square(tmp, op);
+      memcpy(op, tmp, sizeof(op));
+   }
+
+   // one table per byte of the register
+   for (k = 0; k < 4; k++) {
+      for (i = 0; i < 256; i++) {
+         table[k][i] = gf2_times(op, (unsigned int)i << (8 * k));
+      }
+   }
+
+   return;
+}
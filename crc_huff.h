@@ -0,0 +1,25 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      CRC32C (the Castagnoli polynomial, as in iSCSI and ext4) of the
+ *      characters of every stream block.  On x86 processors with SSE4.2
+ *      the crc32 instruction does the work, three lanes at a time so its
+ *      latency is hidden; everywhere else it is table driven, eight bytes
+ *      a step.  The choice is made once, the first time a checksum is
+ *      asked for.
+ *
+ ***************************/
+
+#ifndef HUFFMAN_CRC
+#define HUFFMAN_CRC
+
+#define CHECKSUM_SIZE 4
+
+// function prototypes
+unsigned int crc32c(unsigned int crc, const unsigned char *buf, unsigned long len);
+int crc32c_hardware(void);
+
+#endif //HUFFMAN_CRC
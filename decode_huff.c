@@ -0,0 +1,775 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      This file is the implementation code for the table driven huffman
+ *      decoder.  The primary table is indexed by the next DECODE_BITS bits of
+ *      the stream.  Codes longer than that continue in secondary tables that
+ *      are indexed by the bits following the primary index.  All of the
+ *      tables are stored back to back in one array and are built by walking
+ *      the huffman tree created in tree_huff.c.  When every code fits in the
+ *      primary table the loops go through kernels instantiated for the
+ *      table width and longest code, which decode a fixed number of
+ *      characters per refill of the bit register.
+ *
+ *      Codes that are two or three bits long use a fraction of every lookup,
+ *      so tables whose expected code length (each code of length L taken
+ *      with probability 2^-L, which is what the lengths say about the
+ *      counts) is short also get a multi-character table.  It is filled by
+ *      decoding every index with the primary table as long as the codes
+ *      stay inside it and only built for calls long enough to pay for it.
+ *      Its entries are stored four characters at a time and the position
+ *      moves on by how many were real.
+ *
+ ***************************/
+
+#include <stdlib.h>  // malloc(), realloc(), free()
+#include <string.h>  // memcpy(), memset()
+#include <math.h>    // ldexp()
+#include "decode_huff.h"
+#include "stats_huff.h"
+
+// characters that can be decoded after one refill of at least 56 bits when
+// the index is bits wide and no code is longer than len, the last lookup
+// still needs its whole index among the refilled bits
+#define REFILL_SYMBOLS(bits, len) ((56 - (bits)) / (len) + 1)
+
+// lookups of the multi-character table per refill, and the most characters
+// they can give
+#define MULTI_ROUND REFILL_SYMBOLS(MULTI_BITS, MULTI_BITS)
+#define MULTI_SPAN  (MULTI_ROUND * MULTI_CHARS)
+
+// function prototypes
+static int  tree_depth(struct huff_tree *tree, int node);
+static double expected_len(struct huff_tree *tree, int node, int depth);
+static long add_table(struct decode_table *table, struct huff_tree *tree, int node, int bits);
+static int  fill_table(struct decode_table *table, unsigned int base, struct huff_tree *tree, int node, unsigned int prefix, int depth, int bits);
+KERNEL unsigned char lookup_flat(const struct decode_entry *entries, unsigned int base, int bits, unsigned long long *reg, int *count);
+KERNEL unsigned long lookup_multi(const struct multi_entry *multi, const struct decode_entry *entries, int bits, struct bit_reader *br, unsigned long long *reg, int *count, unsigned char *out);
+KERNEL void decode_run_multi(const struct multi_entry *multi, const struct decode_entry *entries, int bits, struct bit_reader *br, unsigned char *out, unsigned long num);
+KERNEL void decode_run_multi4(const struct multi_entry *multi, const struct decode_entry *entries, int bits, struct bit_reader br[4], unsigned char *out, unsigned long num);
+KERNEL void decode_run(const struct decode_entry *entries, int bits, int max_len, struct bit_reader *br, unsigned char *out, unsigned long num);
+KERNEL void decode_run4(const struct decode_entry *entries, int bits, int max_len, struct bit_reader br[4], unsigned char *out, unsigned long num);
+KERNEL void decode_run_context(const struct decode_entry *entries, const unsigned int pick[MAX_CHARS], int max_len, struct bit_reader *br, unsigned char *out, unsigned long num);
+KERNEL void decode_run_context4(const struct decode_entry *entries, const unsigned int pick[MAX_CHARS], int max_len, struct bit_reader br[4], unsigned char *out, unsigned long num);
+
+int init_bit_reader(struct bit_reader *br, int fd) {
+
+   br->fd = fd;
+   br->pos = 0;
+   br->len = 0;
+   br->bits = 0;
+   br->count = 0;
+   br->eof = 0;
+   br->padded = 0;
+
+   if ((br->buf = (unsigned char *)malloc(READ_BUF_SIZE)) == NULL) {
+      return -1;
+   }
+
+   return 0;
+}
+
+void init_bit_reader_mem(struct bit_reader *br, const unsigned char *buf, unsigned long len) {
+
+   // the whole stream is already in the buffer
+   br->fd = -1;
+   br->buf = (unsigned char *)buf;
+   br->pos = 0;
+   br->len = len;
+   br->bits = 0;
+   br->count = 0;
+   br->eof = 1;
+   br->padded = 0;
+
+   return;
+}
+
+void free_bit_reader(struct bit_reader *br) {
+   if (br->fd != -1) {
+      free(br->buf);
+   }
+   br->buf = NULL;
+
+   return;
+}
+
+void refill_bits_slow(struct bit_reader *br) {
+   // variable declarations
+   long ret = 0;
+
+   while (br->count <= 56) {
+      // out of buffered data, read the next piece of the file
+      if (br->pos == br->len && !br->eof) {
+         if ((ret = stats_read(br->fd, br->buf, READ_BUF_SIZE)) <= 0) {
+            br->eof = 1;
+            ret = 0;
+         }
+         br->pos = 0;
+         br->len = ret;
+
+         // a full buffer can go through the fast path
+         if (br->len >= 8) {
+            refill_bits(br);
+            return;
+         }
+      }
+
+      // past the end of the file the stream is padded with zero bits
+      if (br->pos < br->len) {
+         br->bits |= (unsigned long long)br->buf[br->pos++] << (56 - br->count);
+      } else if (br->padded <= 64) {
+         // a reader that went too far keeps at least 72 padded bits,
+         // more than the register holds, so the overrun sticks
+         br->padded += 8;
+      }
+      br->count += 8;
+   }
+
+   return;
+}
+
+int bit_reader_at_end(struct bit_reader *br) {
+
+   // after a refill every whole byte still in the input is in the register
+   // ahead of the padding, only the unused bits of the last byte may remain
+   refill_bits(br);
+
+   return br->count - br->padded < 8;
+}
+
+void init_decode_table(struct decode_table *table) {
+   table->entries = NULL;
+   table->size = 0;
+   table->cap = 0;
+   table->bits = 0;
+   table->max_len = 0;
+   table->single = 0;
+   table->short_codes = 0;
+   table->multi_built = 0;
+   table->multi = NULL;
+
+   return;
+}
+
+int build_decode_table(struct decode_table *table, struct huff_tree *tree) {
+   // variable declarations
+   long offset = 0;
+
+   // the entries of an earlier build are reused, the array only ever grows
+   table->size = 0;
+   table->bits = 0;
+   table->max_len = 0;
+   table->single = 0;
+   table->short_codes = 0;
+   table->multi_built = 0;
+
+   if (tree->root == -1) {
+      return 0;
+   }
+
+   // a lone character has an empty code, its entries use up no bits
+   table->max_len = tree_depth(tree, tree->root);
+   table->single = (table->max_len == 0);
+   table->short_codes = !table->single && expected_len(tree, tree->root, 0) <= MULTI_MAX_AVG;
+
+   // the primary table is one of the two widths the kernels are built for
+   table->bits = (table->max_len <= DECODE_SMALL_BITS) ? DECODE_SMALL_BITS : DECODE_BITS;
+   STATS_BEGIN(PHASE_CODES);
+   offset = add_table(table, tree, tree->root, table->bits);
+   STATS_END();
+   if (offset < 0) {
+      return -1;
+   }
+
+   return 0;
+}
+
+int add_decode_group(struct decode_table *table, struct huff_tree *tree, unsigned int *base, int *bits) {
+   // variable declarations
+   int depth = tree_depth(tree, tree->root);
+   long offset = 0;
+
+   // the tables go after the ones already built, a context block keeps one
+   // primary table per group in the same array.  No point in a primary
+   // table wider than the longest code
+   *bits = (depth < DECODE_BITS) ? depth : DECODE_BITS;
+   if (*bits == 0) {
+      *bits = 1;
+   }
+   STATS_BEGIN(PHASE_CODES);
+   offset = add_table(table, tree, tree->root, *bits);
+   STATS_END();
+   if (offset < 0) {
+      return -1;
+   }
+   *base = (unsigned int)offset;
+   if (depth > table->max_len) {
+      table->max_len = depth;
+   }
+
+   return 0;
+}
+
+int build_multi_table(struct decode_table *table) {
+   // variable declarations
+   const struct decode_entry *e = NULL;
+   struct multi_entry *m = NULL;
+   unsigned int index = 0;
+   int pos = 0, num = 0;
+
+   if (table->multi_built) {
+      return 0;
+   }
+   if (table->multi == NULL &&
+         (table->multi = (struct multi_entry *)malloc((1u << MULTI_BITS) * sizeof(struct multi_entry))) == NULL) {
+      return -1;
+   }
+
+   // decode each index with the primary table (never wider than the
+   // index) for as long as the next code lies wholly inside it
+   STATS_BEGIN(PHASE_CODES);
+   for (index = 0; index < (1u << MULTI_BITS); index++) {
+      m = &table->multi[index];
+      memset(m->sym, 0, MULTI_CHARS);
+      for (pos = 0, num = 0; num < MULTI_CHARS; num++) {
+         e = &table->entries[((index << pos) & ((1u << MULTI_BITS) - 1)) >> (MULTI_BITS - table->bits)];
+         if (e->sub || e->len > MULTI_BITS - pos) {
+            break;
+         }
+         m->sym[num] = (unsigned char)e->sym;
+         pos += e->len;
+      }
+      m->num = (unsigned char)num;
+      m->len = (unsigned char)pos;
+   }
+   STATS_END();
+   table->multi_built = 1;
+
+   return 0;
+}
+
+void free_decode_table(struct decode_table *table) {
+   free(table->entries);
+   free(table->multi);
+   table->entries = NULL;
+   table->multi = NULL;
+   table->size = 0;
+   table->cap = 0;
+   table->multi_built = 0;
+
+   return;
+}
+
+void decode_symbols(struct decode_table *table, struct bit_reader *br,
+      unsigned char *out, unsigned long num) {
+
+   // pick the kernel for the table's width and longest code, tables with
+   // secondary tables go through the general one.  Short codes go through
+   // the multi-character table once one is built or worth building
+   STATS_ADD(STAT_SYMBOLS, num);
+   if (table->short_codes && (table->multi_built || num >= MULTI_MIN_CHARS) && build_multi_table(table) == 0) {
+      STATS_BEGIN(PHASE_DECODE);
+      decode_run_multi(table->multi, table->entries, table->bits, br, out, num);
+      STATS_END();
+      return;
+   }
+   STATS_BEGIN(PHASE_DECODE);
+   if (table->single || table->max_len > table->bits) {
+      decode_run(table->entries, table->bits, 0, br, out, num);
+   } else if (table->bits == DECODE_SMALL_BITS) {
+      decode_run(table->entries, DECODE_SMALL_BITS, DECODE_SMALL_BITS, br, out, num);
+   } else if (table->max_len <= 9) {
+      decode_run(table->entries, DECODE_BITS, 9, br, out, num);
+   } else {
+      decode_run(table->entries, DECODE_BITS, DECODE_BITS, br, out, num);
+   }
+   STATS_END();
+
+   return;
+}
+
+void decode_symbols4(struct decode_table *table, struct bit_reader br[4],
+      unsigned char *out, unsigned long num) {
+
+   STATS_ADD(STAT_SYMBOLS, num);
+   if (table->short_codes && (table->multi_built || num >= MULTI_MIN_CHARS) && build_multi_table(table) == 0) {
+      STATS_BEGIN(PHASE_DECODE);
+      decode_run_multi4(table->multi, table->entries, table->bits, br, out, num);
+      STATS_END();
+      return;
+   }
+   STATS_BEGIN(PHASE_DECODE);
+   if (table->single || table->max_len > table->bits) {
+      decode_run4(table->entries, table->bits, 0, br, out, num);
+   } else if (table->bits == DECODE_SMALL_BITS) {
+      decode_run4(table->entries, DECODE_SMALL_BITS, DECODE_SMALL_BITS, br, out, num);
+   } else if (table->max_len <= 9) {
+      decode_run4(table->entries, DECODE_BITS, 9, br, out, num);
+   } else {
+      decode_run4(table->entries, DECODE_BITS, DECODE_BITS, br, out, num);
+   }
+   STATS_END();
+
+   return;
+}
+
+void decode_symbols_context(struct decode_table *table, const unsigned int pick[MAX_CHARS],
+      struct bit_reader *br, unsigned char *out, unsigned long num) {
+
+   // the groups' tables are as wide as their longest code up to DECODE_BITS,
+   // so the longest code of all of them bounds every index width
+   STATS_ADD(STAT_SYMBOLS, num);
+   STATS_BEGIN(PHASE_DECODE);
+   if (table->max_len == 0 || table->max_len > DECODE_BITS) {
+      decode_run_context(table->entries, pick, 0, br, out, num);
+   } else if (table->max_len <= DECODE_SMALL_BITS) {
+      decode_run_context(table->entries, pick, DECODE_SMALL_BITS, br, out, num);
+   } else {
+      decode_run_context(table->entries, pick, DECODE_BITS, br, out, num);
+   }
+   STATS_END();
+
+   return;
+}
+
+void decode_symbols_context4(struct decode_table *table, const unsigned int pick[MAX_CHARS],
+      struct bit_reader br[4], unsigned char *out, unsigned long num) {
+
+   STATS_ADD(STAT_SYMBOLS, num);
+   STATS_BEGIN(PHASE_DECODE);
+   if (table->max_len == 0 || table->max_len > DECODE_BITS) {
+      decode_run_context4(table->entries, pick, 0, br, out, num);
+   } else if (table->max_len <= DECODE_SMALL_BITS) {
+      decode_run_context4(table->entries, pick, DECODE_SMALL_BITS, br, out, num);
+   } else {
+      decode_run_context4(table->entries, pick, DECODE_BITS, br, out, num);
+   }
+   STATS_END();
+
+   return;
+}
+
+static int tree_depth(struct huff_tree *tree, int node) {
+   // variable declarations
+   int left = 0, right = 0;
+
+   if ((node == -1) || ((tree->nodes[node].left == -1) && (tree->nodes[node].right == -1))) {
+      return 0;
+   }
+
+   left = tree_depth(tree, tree->nodes[node].left);
+   right = tree_depth(tree, tree->nodes[node].right);
+
+   return 1 + ((left > right) ? left : right);
+}
+
+static double expected_len(struct huff_tree *tree, int node, int depth) {
+
+   // a code of length L stands for a share of about 2^-L of the characters
+   if ((node == -1) || ((tree->nodes[node].left == -1) && (tree->nodes[node].right == -1))) {
+      return (node == -1) ? 0.0 : depth * ldexp(1.0, -depth);
+   }
+
+   return expected_len(tree, tree->nodes[node].left, depth + 1) + expected_len(tree, tree->nodes[node].right, depth + 1);
+}
+
+static long add_table(struct decode_table *table, struct huff_tree *tree, int node, int bits) {
+   // variable declarations
+   unsigned int base = table->size, need = table->size + (1u << bits);
+   struct decode_entry *grown = NULL;
+
+   // grow the entry array, tables are referenced by offset so moving is fine
+   if (need > table->cap) {
+      unsigned int cap = (table->cap == 0) ? (1u << DECODE_BITS) : table->cap;
+      while (cap < need) {
+         cap *= 2;
+      }
+      if ((grown = (struct decode_entry *)realloc(table->entries, cap * sizeof(struct decode_entry))) == NULL) {
+         return -1;
+      }
+      table->entries = grown;
+      table->cap = cap;
+   }
+   table->size = need;
+
+   if (fill_table(table, base, tree, node, 0, 0, bits) < 0) {
+      return -1;
+   }
+
+   return base;
+}
+
+static int fill_table(struct decode_table *table, unsigned int base, struct huff_tree *tree,
+      int node, unsigned int prefix, int depth, int bits) {
+
+   // variable declarations
+   unsigned int i = 0, first = 0, span = 0;
+   int sub_bits = 0;
+   long offset = 0;
+
+   // a missing branch means the codes do not form a complete tree
+   if (node == -1) {
+      return -1;
+   }
+
+   // this is a character node, every index starting with the prefix decodes to it
+   if ((tree->nodes[node].left == -1) && (tree->nodes[node].right == -1)) {
+      span = 1u << (bits - depth);
+      first = base + (prefix << (bits - depth));
+      for (i = 0; i < span; i++) {
+         table->entries[first + i].next = 0;
+         table->entries[first + i].sym = (unsigned short)tree->nodes[node].ch;
+         table->entries[first + i].len = (unsigned char)depth;
+         table->entries[first + i].sub = 0;
+      }
+   }
+   // the index is used up, the rest of the code continues in a secondary table
+   else if (depth == bits) {
+      sub_bits = tree_depth(tree, node);
+      if (sub_bits > DECODE_SUB_BITS) {
+         sub_bits = DECODE_SUB_BITS;
+      }
+      if ((offset = add_table(table, tree, node, sub_bits)) < 0) {
+         return -1;
+      }
+      table->entries[base + prefix].next = (unsigned int)offset;
+      table->entries[base + prefix].sym = 0;
+      table->entries[base + prefix].len = (unsigned char)sub_bits;
+      table->entries[base + prefix].sub = 1;
+   }
+   // this is an intermediate node must go to the left and right child nodes
+   else {
+      if (fill_table(table, base, tree, tree->nodes[node].left, prefix << 1, depth + 1, bits) < 0) {
+         return -1;
+      }
+      if (fill_table(table, base, tree, tree->nodes[node].right, (prefix << 1) | 1, depth + 1, bits) < 0) {
+         return -1;
+      }
+   }
+
+   return 0;
+}
+
+// one lookup in a primary table that resolves every code, on a copy of the
+// register kept in a local so the stores of the characters cannot force it
+// back to memory
+KERNEL unsigned char lookup_flat(const struct decode_entry *entries, unsigned int base, int bits,
+      unsigned long long *reg, int *count) {
+
+   // variable declarations
+   const struct decode_entry *e = &entries[base + (unsigned int)(*reg >> (64 - bits))];
+
+   *reg <<= e->len;
+   *count -= e->len;
+
+   return (unsigned char)e->sym;
+}
+
+// the kernels take max_len as the longest code of a table without secondary
+// tables, or 0 for any table, which decodes a character at a time
+KERNEL void decode_run(const struct decode_entry *entries, int bits, int max_len,
+      struct bit_reader *br, unsigned char *out, unsigned long num) {
+
+   // variable declarations
+   unsigned long i = 0;
+   unsigned long long reg = 0;
+   int count = 0, k = 0;
+
+   if (max_len > 0) {
+      for (; i + REFILL_SYMBOLS(bits, max_len) <= num; i += REFILL_SYMBOLS(bits, max_len)) {
+         refill_bits(br);
+         reg = br->bits;
+         count = br->count;
+         for (k = 0; k < REFILL_SYMBOLS(bits, max_len); k++) {
+            out[i + k] = lookup_flat(entries, 0, bits, &reg, &count);
+         }
+         br->bits = reg;
+         br->count = count;
+      }
+   }
+   for (; i < num; i++) {
+      out[i] = decode_one(entries, bits, br);
+   }
+
+   return;
+}
+
+KERNEL void decode_run4(const struct decode_entry *entries, int bits, int max_len,
+      struct bit_reader br[4], unsigned char *out, unsigned long num) {
+
+   // variable declarations
+   unsigned long seg = STREAM_SEGMENT(num), len[4], i = 0;
+   unsigned char *o0 = out, *o1 = out + seg, *o2 = out + 2 * seg, *o3 = out + 3 * seg;
+   unsigned long long r0 = 0, r1 = 0, r2 = 0, r3 = 0;
+   int c0 = 0, c1 = 0, c2 = 0, c3 = 0, k = 0;
+
+   for (k = 0; k < 4; k++) {
+      len[k] = (num > k * seg) ? ((num - k * seg < seg) ? num - k * seg : seg) : 0;
+   }
+
+   // the four streams are independent, so the lookups of one round do not
+   // wait on each other and the core can keep them all in flight
+   if (max_len > 0) {
+      for (; i + REFILL_SYMBOLS(bits, max_len) <= len[3]; i += REFILL_SYMBOLS(bits, max_len)) {
+         refill_bits(&br[0]);
+         refill_bits(&br[1]);
+         refill_bits(&br[2]);
+         refill_bits(&br[3]);
+         r0 = br[0].bits;
+         r1 = br[1].bits;
+         r2 = br[2].bits;
+         r3 = br[3].bits;
+         c0 = br[0].count;
+         c1 = br[1].count;
+         c2 = br[2].count;
+         c3 = br[3].count;
+         for (k = 0; k < REFILL_SYMBOLS(bits, max_len); k++) {
+            o0[i + k] = lookup_flat(entries, 0, bits, &r0, &c0);
+            o1[i + k] = lookup_flat(entries, 0, bits, &r1, &c1);
+            o2[i + k] = lookup_flat(entries, 0, bits, &r2, &c2);
+            o3[i + k] = lookup_flat(entries, 0, bits, &r3, &c3);
+         }
+         br[0].bits = r0;
+         br[1].bits = r1;
+         br[2].bits = r2;
+         br[3].bits = r3;
+         br[0].count = c0;
+         br[1].count = c1;
+         br[2].count = c2;
+         br[3].count = c3;
+      }
+   }
+   for (; i < len[3]; i++) {
+      o0[i] = decode_one(entries, bits, &br[0]);
+      o1[i] = decode_one(entries, bits, &br[1]);
+      o2[i] = decode_one(entries, bits, &br[2]);
+      o3[i] = decode_one(entries, bits, &br[3]);
+   }
+
+   // the last segment may be shorter than the others
+   for (k = 0; k < 3; k++) {
+      for (i = len[3]; i < len[k]; i++) {
+         out[k * seg + i] = decode_one(entries, bits, &br[k]);
+      }
+   }
+
+   return;
+}
+
+// one lookup in the multi-character table, all four of its characters are
+// stored and the count of real ones returned.  A code longer than the index
+// goes through the primary table, after which the register is refilled so
+// the rest of the round still has the bits it counts on
+KERNEL unsigned long lookup_multi(const struct multi_entry *multi, const struct decode_entry *entries, int bits,
+      struct bit_reader *br, unsigned long long *reg, int *count, unsigned char *out) {
+
+   // variable declarations
+   const struct multi_entry *e = &multi[*reg >> (64 - MULTI_BITS)];
+
+   if (e->num == 0) {
+      br->bits = *reg;
+      br->count = *count;
+      *out = decode_one(entries, bits, br);
+      refill_bits(br);
+      *reg = br->bits;
+      *count = br->count;
+      return 1;
+   }
+   memcpy(out, e->sym, MULTI_CHARS);
+   *reg <<= e->len;
+   *count -= e->len;
+
+   return e->num;
+}
+
+// a round may store up to MULTI_SPAN characters, so rounds only run while
+// that many are left and the rest are decoded one at a time
+KERNEL void decode_run_multi(const struct multi_entry *multi, const struct decode_entry *entries, int bits,
+      struct bit_reader *br, unsigned char *out, unsigned long num) {
+
+   // variable declarations
+   unsigned long i = 0;
+   unsigned long long reg = 0;
+   int count = 0, k = 0;
+
+   while (i + MULTI_SPAN <= num) {
+      refill_bits(br);
+      reg = br->bits;
+      count = br->count;
+      for (k = 0; k < MULTI_ROUND; k++) {
+         i += lookup_multi(multi, entries, bits, br, &reg, &count, out + i);
+      }
+      br->bits = reg;
+      br->count = count;
+   }
+   for (; i < num; i++) {
+      out[i] = decode_one(entries, bits, br);
+   }
+
+   return;
+}
+
+KERNEL void decode_run_multi4(const struct multi_entry *multi, const struct decode_entry *entries, int bits,
+      struct bit_reader br[4], unsigned char *out, unsigned long num) {
+
+   // variable declarations
+   unsigned long seg = STREAM_SEGMENT(num), len[4], i0 = 0, i1 = 0, i2 = 0, i3 = 0, i = 0;
+   unsigned char *o0 = out, *o1 = out + seg, *o2 = out + 2 * seg, *o3 = out + 3 * seg;
+   unsigned long long r0 = 0, r1 = 0, r2 = 0, r3 = 0;
+   int c0 = 0, c1 = 0, c2 = 0, c3 = 0, k = 0;
+
+   for (k = 0; k < 4; k++) {
+      len[k] = (num > k * seg) ? ((num - k * seg < seg) ? num - k * seg : seg) : 0;
+   }
+
+   // the streams move on at their own pace, the rounds stop when any of
+   // them is close to the end of its segment
+   while (i0 + MULTI_SPAN <= len[0] && i1 + MULTI_SPAN <= len[1] && i2 + MULTI_SPAN <= len[2] && i3 + MULTI_SPAN <= len[3]) {
+      refill_bits(&br[0]);
+      refill_bits(&br[1]);
+      refill_bits(&br[2]);
+      refill_bits(&br[3]);
+      r0 = br[0].bits;
+      r1 = br[1].bits;
+      r2 = br[2].bits;
+      r3 = br[3].bits;
+      c0 = br[0].count;
+      c1 = br[1].count;
+      c2 = br[2].count;
+      c3 = br[3].count;
+      for (k = 0; k < MULTI_ROUND; k++) {
+         i0 += lookup_multi(multi, entries, bits, &br[0], &r0, &c0, o0 + i0);
+         i1 += lookup_multi(multi, entries, bits, &br[1], &r1, &c1, o1 + i1);
+         i2 += lookup_multi(multi, entries, bits, &br[2], &r2, &c2, o2 + i2);
+         i3 += lookup_multi(multi, entries, bits, &br[3], &r3, &c3, o3 + i3);
+      }
+      br[0].bits = r0;
+      br[1].bits = r1;
+      br[2].bits = r2;
+      br[3].bits = r3;
+      br[0].count = c0;
+      br[1].count = c1;
+      br[2].count = c2;
+      br[3].count = c3;
+   }
+
+   // each segment finishes a character at a time
+   for (k = 0; k < 4; k++) {
+      i = (k == 0) ? i0 : (k == 1) ? i1 : (k == 2) ? i2 : i3;
+      for (; i < len[k]; i++) {
+         out[k * seg + i] = decode_one(entries, bits, &br[k]);
+      }
+   }
+
+   return;
+}
+
+// for the context kernels max_len also bounds the index width of every
+// group's table, the width itself comes with the group in the pick
+KERNEL void decode_run_context(const struct decode_entry *entries, const unsigned int pick[MAX_CHARS], int max_len,
+      struct bit_reader *br, unsigned char *out, unsigned long num) {
+
+   // variable declarations
+   unsigned long i = 0;
+   unsigned long long reg = 0;
+   unsigned int p = pick[0];
+   int count = 0, k = 0;
+
+   // the table for the next character follows from the one just decoded,
+   // the first one of the payload follows a zero
+   if (max_len > 0) {
+      for (; i + REFILL_SYMBOLS(max_len, max_len) <= num; i += REFILL_SYMBOLS(max_len, max_len)) {
+         refill_bits(br);
+         reg = br->bits;
+         count = br->count;
+         for (k = 0; k < REFILL_SYMBOLS(max_len, max_len); k++) {
+            out[i + k] = lookup_flat(entries, p >> 4, p & 0x0F, &reg, &count);
+            p = pick[out[i + k]];
+         }
+         br->bits = reg;
+         br->count = count;
+      }
+   }
+   for (; i < num; i++) {
+      out[i] = decode_one_at(entries, p >> 4, p & 0x0F, br);
+      p = pick[out[i]];
+   }
+
+   return;
+}
+
+KERNEL void decode_run_context4(const struct decode_entry *entries, const unsigned int pick[MAX_CHARS], int max_len,
+      struct bit_reader br[4], unsigned char *out, unsigned long num) {
+
+   // variable declarations
+   unsigned long seg = STREAM_SEGMENT(num), len[4], i = 0;
+   unsigned char *o0 = out, *o1 = out + seg, *o2 = out + 2 * seg, *o3 = out + 3 * seg;
+   unsigned int p0 = pick[0], p1 = pick[0], p2 = pick[0], p3 = pick[0], p = 0;
+   unsigned long long r0 = 0, r1 = 0, r2 = 0, r3 = 0;
+   int c0 = 0, c1 = 0, c2 = 0, c3 = 0, k = 0;
+
+   for (k = 0; k < 4; k++) {
+      len[k] = (num > k * seg) ? ((num - k * seg < seg) ? num - k * seg : seg) : 0;
+   }
+
+   // every segment starts after a zero, so the four context chains are as
+   // independent as the streams
+   if (max_len > 0) {
+      for (; i + REFILL_SYMBOLS(max_len, max_len) <= len[3]; i += REFILL_SYMBOLS(max_len, max_len)) {
+         refill_bits(&br[0]);
+         refill_bits(&br[1]);
+         refill_bits(&br[2]);
+         refill_bits(&br[3]);
+         r0 = br[0].bits;
+         r1 = br[1].bits;
+         r2 = br[2].bits;
+         r3 = br[3].bits;
+         c0 = br[0].count;
+         c1 = br[1].count;
+         c2 = br[2].count;
+         c3 = br[3].count;
+         for (k = 0; k < REFILL_SYMBOLS(max_len, max_len); k++) {
+            o0[i + k] = lookup_flat(entries, p0 >> 4, p0 & 0x0F, &r0, &c0);
+            o1[i + k] = lookup_flat(entries, p1 >> 4, p1 & 0x0F, &r1, &c1);
+            o2[i + k] = lookup_flat(entries, p2 >> 4, p2 & 0x0F, &r2, &c2);
+            o3[i + k] = lookup_flat(entries, p3 >> 4, p3 & 0x0F, &r3, &c3);
+            p0 = pick[o0[i + k]];
+            p1 = pick[o1[i + k]];
+            p2 = pick[o2[i + k]];
+            p3 = pick[o3[i + k]];
+         }
+         br[0].bits = r0;
+         br[1].bits = r1;
+         br[2].bits = r2;
+         br[3].bits = r3;
+         br[0].count = c0;
+         br[1].count = c1;
+         br[2].count = c2;
+         br[3].count = c3;
+      }
+   }
+   for (; i < len[3]; i++) {
+      o0[i] = decode_one_at(entries, p0 >> 4, p0 & 0x0F, &br[0]);
+      o1[i] = decode_one_at(entries, p1 >> 4, p1 & 0x0F, &br[1]);
+      o2[i] = decode_one_at(entries, p2 >> 4, p2 & 0x0F, &br[2]);
+      o3[i] = decode_one_at(entries, p3 >> 4, p3 & 0x0F, &br[3]);
+      p0 = pick[o0[i]];
+      p1 = pick[o1[i]];
+      p2 = pick[o2[i]];
+      p3 = pick[o3[i]];
+   }
+
+   // the last segment may be shorter than the others
+   for (k = 0; k < 3; k++) {
+      p = (k == 0) ? p0 : (k == 1) ? p1 : p2;
+      for (i = len[3]; i < len[k]; i++) {
+         out[k * seg + i] = decode_one_at(entries, p >> 4, p & 0x0F, &br[k]);
+         p = pick[out[k * seg + i]];
+      }
+   }
+
+   return;
+}
@@ -0,0 +1,161 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      Table driven huffman decoding.  The decode table is built once from the
+ *      huffman tree and resolves a whole code per lookup instead of walking
+ *      the tree one bit at a time.  Bits are served from a 64-bit register
+ *      that is refilled from a large input buffer or served straight out of a
+ *      memory mapped file.  Reading past the end of the input yields zero
+ *      bits and is recorded, so truncated input can be reported.
+ *
+ *      When the codes are short a second table, built from the first, holds
+ *      every code that lies wholly inside its index, up to MULTI_CHARS of
+ *      them, and a single lookup decodes them all.
+ *
+ ***************************/
+
+#ifndef HUFFMAN_DECODE
+#define HUFFMAN_DECODE
+
+#include "tree_huff.h"
+
+#define DECODE_BITS       11     // index width of the primary table
+#define DECODE_SMALL_BITS 8      // primary table width for codes of 8 bits or less
+#define DECODE_SUB_BITS   8      // maximum index width of a secondary table
+#define READ_BUF_SIZE   (1 << 16)
+
+#define MULTI_BITS      DECODE_BITS   // index width of the multi-character table
+#define MULTI_CHARS     4             // most characters one of its entries decodes
+#define MULTI_MAX_AVG   5.0           // expected code length, in bits, up to which it is used
+#define MULTI_MIN_CHARS (1ul << 13)   // fewest characters a call decodes to build it
+
+// where a context's table starts and its index width, packed in one word
+#define DECODE_PICK(base, bits) (((unsigned int)(base) << 4) | (unsigned int)(bits))
+
+// characters in each of the four segments of a four stream payload, the
+// last segment takes what is left
+#define STREAM_SEGMENT(num) (((num) + 3) / 4)
+
+struct bit_reader {
+   int fd;                       // -1 when reading from a caller's buffer
+   unsigned char *buf;
+   unsigned long pos;
+   unsigned long len;
+   unsigned long long bits;      // next bits of the stream, msb first
+   int count;                    // number of valid bits in the register
+   int eof;
+   int padded;                   // zero bits added past the end of the input
+};
+
+struct decode_entry {
+   unsigned int next;            // offset of the secondary table (links only)
+   unsigned short sym;           // decoded character
+   unsigned char len;            // bits used at this level (index width for links)
+   unsigned char sub;            // nonzero when the entry links to a secondary table
+};
+
+struct multi_entry {
+   unsigned char sym[MULTI_CHARS];   // the characters, in order
+   unsigned char num;                // how many, zero when the first code is longer than the index
+   unsigned char len;                // bits they use together
+};
+
+struct decode_table {
+   struct decode_entry *entries;
+   unsigned int size;
+   unsigned int cap;
+   int bits;                     // index width of the primary table
+   int max_len;                  // longest code of all the groups
+   int single;                   // the tree is a single character, no bits are used
+   int short_codes;              // short enough on average for the multi-character table
+   int multi_built;              // the multi-character table matches the codes
+   struct multi_entry *multi;
+};
+
+// function prototypes
+int  init_bit_reader(struct bit_reader *br, int fd);
+void init_bit_reader_mem(struct bit_reader *br, const unsigned char *buf, unsigned long len);
+void free_bit_reader(struct bit_reader *br);
+void refill_bits_slow(struct bit_reader *br);
+int  bit_reader_at_end(struct bit_reader *br);
+void init_decode_table(struct decode_table *table);
+int  build_decode_table(struct decode_table *table, struct huff_tree *tree);
+int  add_decode_group(struct decode_table *table, struct huff_tree *tree, unsigned int *base, int *bits);
+int  build_multi_table(struct decode_table *table);
+void free_decode_table(struct decode_table *table);
+void decode_symbols(struct decode_table *table, struct bit_reader *br, unsigned char *out, unsigned long num);
+void decode_symbols4(struct decode_table *table, struct bit_reader br[4], unsigned char *out, unsigned long num);
+void decode_symbols_context(struct decode_table *table, const unsigned int pick[MAX_CHARS], struct bit_reader *br, unsigned char *out, unsigned long num);
+void decode_symbols_context4(struct decode_table *table, const unsigned int pick[MAX_CHARS], struct bit_reader br[4], unsigned char *out, unsigned long num);
+
+// make sure at least 56 bits are in the register
+static inline void refill_bits(struct bit_reader *br) {
+   // fast path, load 8 bytes at once and keep as many as fit
+   if (br->len - br->pos >= 8) {
+      const unsigned char *p = br->buf + br->pos;
+      unsigned long long v = ((unsigned long long)p[0] << 56) | ((unsigned long long)p[1] << 48) |
+         ((unsigned long long)p[2] << 40) | ((unsigned long long)p[3] << 32) |
+         ((unsigned long long)p[4] << 24) | ((unsigned long long)p[5] << 16) |
+         ((unsigned long long)p[6] << 8) | (unsigned long long)p[7];
+      br->bits |= v >> br->count;
+      br->pos += (63 - br->count) >> 3;
+      br->count |= 56;
+   } else {
+      refill_bits_slow(br);
+   }
+}
+
+static inline unsigned int peek_bits(struct bit_reader *br, int n) {
+   return (unsigned int)(br->bits >> (64 - n));
+}
+
+static inline void consume_bits(struct bit_reader *br, int n) {
+   br->bits <<= n;
+   br->count -= n;
+}
+
+// take the next n (1 to 32) bits, used for the header fields
+static inline unsigned int get_bits(struct bit_reader *br, int n) {
+   // variable declarations
+   unsigned int value = 0;
+
+   refill_bits(br);
+   value = peek_bits(br, n);
+   consume_bits(br, n);
+
+   return value;
+}
+
+// decode one character with the primary table at base, following the
+// links into the secondary tables
+static inline unsigned char decode_one_at(const struct decode_entry *entries, unsigned int base, int bits, struct bit_reader *br) {
+   // variable declarations
+   const struct decode_entry *e = NULL;
+
+   refill_bits(br);
+   e = &entries[base + peek_bits(br, bits)];
+   while (e->sub) {
+      consume_bits(br, bits);
+      refill_bits(br);
+      bits = e->len;
+      e = &entries[e->next + peek_bits(br, bits)];
+   }
+   consume_bits(br, e->len);
+
+   return (unsigned char)e->sym;
+}
+
+static inline unsigned char decode_one(const struct decode_entry *entries, int bits, struct bit_reader *br) {
+   return decode_one_at(entries, 0, bits, br);
+}
+
+// the padding sits at the bottom of the register, once fewer bits are left
+// than were padded the reader has gone past the end of the input
+static inline int bit_reader_overrun(struct bit_reader *br) {
+   return br->padded > br->count;
+}
+
+#endif //HUFFMAN_DECODE
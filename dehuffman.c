@@ -17,71 +17,319 @@
  *
  ***************************/
 
-#include <stdio.h>   // printf() 
+#include <stdio.h>   // fprintf(), fdopen(), fclose()
 #include <fcntl.h>   // open()
-#include <unistd.h>  // read(), close()
-#include <stdlib.h>  // exit()
-#include <string.h>  // strncpy()
+#include <unistd.h>  // read(), close(), getopt(), sysconf()
+#include <stdlib.h>  // exit(), malloc(), strtoull(), strtol(), atexit()
+#include <string.h>  // strncpy(), strcmp(), memcpy()
+#include <getopt.h>  // getopt_long()
 
+#include "huff.h"
 #include "tree_huff.h"
+#include "decode_huff.h"
+#include "block_huff.h"
+#include "archive_huff.h"
+#include "io_huff.h"
+#include "pool_huff.h"
 
 #define FILE_NAME_MAX_LEN 270
 #define MAX_FILE_NAME 256
 #define MAX_CHARS 256
+#define MAX_TRACE 50
+
+// the formats told apart by the last magic number byte
+#define FORMAT_LEGACY    0
+#define FORMAT_CANONICAL 1
+#define FORMAT_STREAM    2
+#define FORMAT_DICT      3
+#define FORMAT_ARCHIVE   4
+#define MAX_DICTS        16
+#define OUT_CHUNK (1 << 16)
+
+// how much goes to the standard error besides errors
+#define VERBOSE_QUIET  0      // nothing
+#define VERBOSE_NORMAL 1      // the characters and their codes
+#define VERBOSE_TRACE  2      // and the translation of the first characters
 
 // function prototypes
-void check_magic_num(int fd);
-void get_bit_vector(int fd, unsigned char bit_vector[32]);
-int  get_size(int fd);
-void get_character_counts(int fd, int freq[MAX_CHARS], int num_bytes, unsigned char bit_vector[32], const char *const ASCII[]);
-int  get_freq(int fd, int num_bytes);
-void generate_message(int fd, struct node *tree_head, char code[MAX_CHARS], const char *const ASCII[], int freq[MAX_CHARS]);
-int get_bit(int fd);
+int  check_magic_num(int fd);
+int  parse_range(const char *arg, unsigned long long *start, unsigned long long *len);
+int  parse_threads(const char *arg, int *threads);
+int  load_dict_file(const char *name, struct huff_dict *dict);
+int  decompress_dict_message(int fd, struct huff_dict dicts[], int num_dicts, FILE *file_out);
+void read_archive(int fd, const char *name, int list, const char *extract, int verify, int threads, FILE *file_out, int quiet);
+void get_bit_vector(struct bit_reader *br, unsigned char bit_vector[32]);
+int  get_size(struct bit_reader *br);
+void get_character_counts(struct bit_reader *br, int freq[MAX_CHARS], int num_bytes, unsigned char bit_vector[32], const char *const ASCII[], int verbose);
+int  get_freq(struct bit_reader *br, int num_bytes);
+unsigned long get_total(struct bit_reader *br);
+void get_code_lengths(struct bit_reader *br, int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS], unsigned char bit_vector[32], const char *const ASCII[], int verbose);
+void generate_message(struct bit_reader *br, struct huff_tree *tree, int node, char code[MAX_CODE_BITS + 1], const char *const ASCII[], int freq[MAX_CHARS], struct output_file *out, int verbose, int *traced);
+int  get_bit(struct bit_reader *br);
+void decode_message(struct bit_reader *br, struct huff_tree *tree, unsigned long total, struct code code_values[MAX_CHARS], const char *const ASCII[], struct output_file *out, int verbose);
+void print_translation(int count, const char *code, int ch, const char *const ASCII[]);
+void print_stats(void);
 
 int main(int argc, char *argv[]) {
 
    // variable declarations
-   int freq[MAX_CHARS] = {0}, fd, num_bytes = 0, ret = 0, i = 0, num_chars = 0;
-   unsigned char bit_vector[32] = {0x00};
-   char s[MAX_PATH] = "", code[MAX_PATH] = "";
-   struct code code_values[MAX_CHARS] = {{-1,{0},0}};
+   int freq[MAX_CHARS] = {0}, fd, fd_out = STDOUT_FILENO, num_bytes = 0, ret = 0, i = 0, num_chars = 0, opt = 0, reference = 0, format = 0, threads = 0;
+   int quiet = 0, trace = 0, verbose = VERBOSE_NORMAL;
+   const char *output_name = NULL;
+   unsigned long long range_start = 0, range_len = 0;
+   int range = 0, num_dicts = 0, verify = 0, list = 0, traced = 0;
+   const char *extract = NULL;
+   struct huff_dict dicts[MAX_DICTS];
+   const struct option long_options[] = {{"range", required_argument, NULL, 'R'}, {"stats", no_argument, NULL, 'S'},
+      {"verify", no_argument, NULL, 'V'}, {"list", no_argument, NULL, 'L'}, {"extract", required_argument, NULL, 'X'},
+      {NULL, 0, NULL, 0}};
+   FILE *file_out = stdout;
+   unsigned char bit_vector[32] = {0x00}, lengths[MAX_CHARS] = {0};
+   char code[MAX_CODE_BITS + 1] = "";
+   unsigned long total = 0, count = 0;
+   struct huff_tree tree = {.root = -1};
+   struct code code_values[MAX_CHARS] = {{-1, 0, 0}};
+   struct input_file input;
+   struct output_file out;
+   struct bit_reader br;
    const char * const ASCII[] = {"NUL", "SOH", "STX", "ETX", "EOT", "ENQ", "ACK", "BEL",
       "BS", "HT", "NL", "VT", "NP", "CR", "SO", "SI", "DLE",
       "DC1", "DC2", "DC3", "DC4", "NAK", "SYN", "ETB", "CAN", "EM",
       "SUB", "ESC", "FS", "GS", "RS", "US" , "SP"};
 
+   // -r decodes with the original bit by bit tree walk, -T decodes the
+   // blocks of the stream format with that many threads, -o writes to a
+   // file instead of the standard output, -q drops the diagnostics (so
+   // does -o) and -v adds the translation of the first characters.
+   // --range START:LEN decodes only those characters of a stream file.
+   // -D loads a dictionary for messages coded with one, it can be given
+   // more than once and the message's id picks the one used.  --verify
+   // decodes and checks the block checksums without writing anything, on
+   // every processor unless -T says otherwise.  --list prints the entries
+   // of an archive and --extract NAME decodes the one entry.  --stats
+   // writes the phase times and counters to the standard error as JSON
+   while ((opt = getopt_long(argc, argv, "rqvo:T:D:", long_options, NULL)) != -1) {
+      if (opt == 'r') {
+         reference = 1;
+      } else if (opt == 'q') {
+         quiet = 1;
+      } else if (opt == 'v') {
+         trace = 1;
+      } else if (opt == 'o') {
+         output_name = optarg;
+      } else if (opt == 'T' && parse_threads(optarg, &threads) == 0) {
+         // parse_threads() has checked and clamped the count
+      } else if (opt == 'R' && parse_range(optarg, &range_start, &range_len) == 0) {
+         range = 1;
+      } else if (opt == 'D' && num_dicts < MAX_DICTS) {
+         if (load_dict_file(optarg, &dicts[num_dicts]) != 0) {
+            fprintf(stderr, "%s is not a dictionary.\n", optarg);
+            exit(1);
+         }
+         num_dicts++;
+      } else if (opt == 'S') {
+         stats_enable(1);
+         atexit(print_stats);
+      } else if (opt == 'V') {
+         verify = 1;
+      } else if (opt == 'L') {
+         list = 1;
+      } else if (opt == 'X') {
+         extract = optarg;
+      } else {
+         fprintf(stderr, "Format needs to be: ./dehuffman [-r] [-q] [-v] [-o output] [-T threads] [-D dictionary]... [--range START:LEN] [--verify] [--stats] filename\n"
+               "                  or: ./dehuffman --list archive | --extract name [-o output] archive\n");
+         exit(1);
+      }
+   }
+
    // check that the input file was specified
-   if (argc != 2) {
-      fprintf(stderr, "Format needs to be: ./dehuffman filename\n");
+   if (optind != argc - 1) {
+      fprintf(stderr, "Format needs to be: ./dehuffman [-r] [-q] [-v] [-o output] [-T threads] [-D dictionary]... [--range START:LEN] [--verify] [--stats] filename\n"
+               "                  or: ./dehuffman --list archive | --extract name [-o output] archive\n");
+      exit(1);
+   }
+
+   if (verify && (range || output_name != NULL)) {
+      fprintf(stderr, "--verify checks the whole file and writes nothing, it takes neither --range nor -o.\n");
       exit(1);
    }
+   if (threads <= 0) {
+      threads = verify ? (int)sysconf(_SC_NPROCESSORS_ONLN) : 1;
+   }
+   if (threads <= 0) {
+      threads = 1;
+   } else if (threads > MAX_THREADS) {
+      threads = MAX_THREADS;
+   }
 
-   // open the input file for reading
-   if ((fd = open(argv[1], O_RDONLY)) == -1) {
+   if (trace) {
+      verbose = VERBOSE_TRACE;
+   } else if (quiet || output_name != NULL || verify) {
+      verbose = VERBOSE_QUIET;
+   }
+
+   // open the output file, it is read and written so it can be mapped.
+   // What is verified is decoded into nothing
+   if (output_name != NULL && (fd_out = open(output_name, O_RDWR | O_CREAT | O_TRUNC, 0666)) == -1) {
+      fprintf(stderr, "Failed to open the output file.\n");
+      exit(1);
+   }
+   if (verify && (fd_out = open("/dev/null", O_WRONLY)) == -1) {
+      fprintf(stderr, "Failed to open /dev/null.\n");
+      exit(1);
+   }
+
+   // open the input file for reading, "-" is standard input
+   if (strcmp(argv[optind], "-") == 0) {
+      fd = STDIN_FILENO;
+   } else if ((fd = open(argv[optind], O_RDONLY)) == -1) {
       fprintf(stderr, "Failed to opent the input file.\n");
       exit(1);
    }
 
    // check that the magic number is there and correct
-   check_magic_num(fd);
+   format = check_magic_num(fd);
 
-   // get the bit vector
-   get_bit_vector(fd, bit_vector);
+   // a range can only be found through the stream format's blocks
+   if (range && format != FORMAT_STREAM) {
+      fprintf(stderr, "--range needs a file written with huffman -s.\n");
+      exit(1);
+   }
+   if ((list || extract != NULL) && format != FORMAT_ARCHIVE) {
+      fprintf(stderr, "--list and --extract need an archive written with huffman --archive.\n");
+      exit(1);
+   }
 
-   // get the size
-   num_bytes = get_size(fd);
+   // an archive is only read through its directory
+   if (format == FORMAT_ARCHIVE) {
+      if (output_name != NULL && (file_out = fdopen(fd_out, "w")) == NULL) {
+         fprintf(stderr, "Failed to open the output file.\n");
+         exit(1);
+      }
+      read_archive(fd, argv[optind], list, extract, verify, threads, file_out, quiet);
+      if (fclose(file_out) != 0) {
+         fprintf(stderr, "Failure to write the decoded characters.\n");
+         exit(1);
+      }
+      close(fd);
+      return 0;
+   }
 
-   // get the characters frequency
-   get_character_counts(fd, freq, num_bytes, bit_vector, ASCII);
+   // a message coded with a dictionary is decoded whole
+   if (format == FORMAT_DICT) {
+      if ((output_name != NULL || verify) && (file_out = fdopen(fd_out, "w")) == NULL) {
+         fprintf(stderr, "Failed to open the output file.\n");
+         exit(1);
+      }
+      if ((ret = decompress_dict_message(fd, dicts, num_dicts, file_out)) != HUFF_OK) {
+         fprintf(stderr, "Decompression failed: %s.\n", (ret == HUFF_ERR_ARGUMENT) ? "no dictionary with the message's id" : huff_error_string(ret));
+         exit(1);
+      }
+      if (fclose(file_out) != 0) {
+         fprintf(stderr, "Failure to write the decoded characters.\n");
+         exit(1);
+      }
+      for (i = 0; i < num_dicts; i++) {
+         free_dict(&dicts[i]);
+      }
+      if (verify && !quiet) {
+         fprintf(stderr, "%s: OK\n", argv[optind]);
+      }
+      close(fd);
+      return 0;
+   }
 
-   // build the tree
-   struct node *tree_head = generate_tree(freq);
+   // the stream format is decoded a block at a time, when verifying the
+   // workers check their blocks and nothing is written
+   if (format == FORMAT_STREAM) {
+      if (output_name != NULL && (file_out = fdopen(fd_out, "w")) == NULL) {
+         fprintf(stderr, "Failed to open the output file.\n");
+         exit(1);
+      }
+      if (range) {
+         ret = decompress_range(fd, file_out, range_start, range_len);
+      } else {
+         ret = decompress_stream(fd, verify ? -1 : fd_out, threads);
+      }
+      if (ret != HUFF_OK) {
+         fprintf(stderr, "%s failed: %s.\n", verify ? "Verification" : "Decompression", huff_error_string(ret));
+         exit(1);
+      }
+      if (fclose(file_out) != 0) {
+         fprintf(stderr, "Failure to write the decoded characters.\n");
+         exit(1);
+      }
+      if (verbose) {
+         fprintf(stderr, "Normal end of file reached\n");
+      } else if (verify && !quiet) {
+         fprintf(stderr, "%s: OK\n", argv[optind]);
+      }
+      close(fd);
+      return 0;
+   }
 
-   // generate the huffman codes
-   build_codes(tree_head, code_values, s, 0);
+   // the rest of a regular file is mapped, anything else is read through
+   // the bit reader's buffer
+   if (map_file(fd, &input) == 0) {
+      init_bit_reader_mem(&br, input.data, input.len);
+   } else if (init_bit_reader(&br, fd) != 0) {
+      fprintf(stderr, "Failure to allocate the input buffer.\n");
+      exit(1);
+   }
+
+   // get the bit vector
+   get_bit_vector(&br, bit_vector);
+
+   if (format == FORMAT_CANONICAL) {
+      // the canonical codes are rebuilt from the code lengths alone
+      total = get_total(&br);
+      get_code_lengths(&br, freq, lengths, bit_vector, ASCII, verbose);
+      if (total > 0 && !valid_code_lengths(freq, lengths)) {
+         fprintf(stderr, "Bad code lengths in file.\n");
+         exit(1);
+      }
+      build_canonical_codes(freq, lengths, code_values);
+      if (total > 0 && generate_code_tree(&tree, code_values) != 0) {
+         fprintf(stderr, "Failure to build the code tree.\n");
+         exit(1);
+      }
+   } else {
+      // get the size
+      num_bytes = get_size(&br);
+
+      // get the characters frequency
+      get_character_counts(&br, freq, num_bytes, bit_vector, ASCII, verbose);
+
+      // build the tree
+      generate_tree(&tree, freq);
+      total = (tree.root != -1) ? tree.nodes[tree.root].freq : 0;
+
+      // generate the huffman codes
+      STATS_BEGIN(PHASE_CODES);
+      build_codes(&tree, tree.root, code_values, 0, 0);
+      STATS_END();
+   }
 
    // print to the user the frequency of the characters in the file
-   for (i = 0; i < MAX_CHARS; i++) {
+   for (i = 0; i < MAX_CHARS && format == FORMAT_CANONICAL && verbose; i++) {
+      if ((bit_vector[i/8] >> (i%8)) & 0x01) {
+         if (i < 33) {
+            fprintf(stderr, "Character %3s (0x%02x) has a %2d bit code.  ", ASCII[i], i, lengths[i]);
+         } else if (i < 127) {
+            fprintf(stderr, "Character %3c (0x%x) has a %2d bit code.  ", i, i, lengths[i]);
+         } else if (i == 127) {
+            fprintf(stderr, "Character DEL (0x%x) has a %2d bit code.  ", i, lengths[i]);
+         } else {
+            fprintf(stderr, "Character     (0x%x) has a %2d bit code.  ", i, lengths[i]);
+         }
+
+         fprintf(stderr, "Expected encoding is <%s>\n", code_to_string(&code_values[i], code));
+         num_chars++;
+      }
+   }
+
+   for (i = 0; i < MAX_CHARS && format == FORMAT_LEGACY && verbose; i++) {
       if ((bit_vector[i/8] >> (i%8)) & 0x01) {
          if (i < 33) {
             fprintf(stderr, "Character %3s (0x%02x) occurred %3d %-5s in the file.  ", ASCII[i], i, freq[i], (freq[i] == 1) ? "time" : "times");
@@ -93,20 +341,55 @@ int main(int argc, char *argv[]) {
             fprintf(stderr, "Character     (0x%x) occurred %3d %-5s in the file.  ", i, freq[i], (freq[i] == 1) ? "time" : "times");
          }
 
-         fprintf(stderr, "Expected encoding is <%s>\n", code_values[i].path);
+         fprintf(stderr, "Expected encoding is <%s>\n", code_to_string(&code_values[i], code));
          num_chars++;
       }
    }
 
+   // the total is known, so an output file is mapped at its final size,
+   // anything else is written from a large buffer
+   if ((output_name == NULL || map_output(fd_out, total, &out) != 0) && open_output(fd_out, &out) != 0) {
+      fprintf(stderr, "Failure to allocate the output buffer.\n");
+      exit(1);
+   }
+
    // generate the original content for the user
-   if (tree_head != NULL) {
-      for (i = 0; i < tree_head->freq; i++) {
-         generate_message(fd, tree_head, code, ASCII, freq);
-         strncpy(code, "", MAX_PATH);
+   if (tree.root != -1 && reference) {
+      STATS_ADD(STAT_SYMBOLS, total);
+      STATS_BEGIN(PHASE_DECODE);
+      for (count = 0; count < total; count++) {
+         strncpy(code, "", MAX_CODE_BITS + 1);
+         generate_message(&br, &tree, tree.root, code, ASCII, freq, &out, verbose, &traced);
       }
+      STATS_END();
+   } else if (tree.root != -1) {
+      decode_message(&br, &tree, total, code_values, ASCII, &out, verbose);
+   }
+
+   // the payload must end with the last character, padding aside
+   if (bit_reader_overrun(&br)) {
+      fprintf(stderr, "The compressed data is truncated.\n");
+      exit(1);
+   }
+   if (!bit_reader_at_end(&br)) {
+      fprintf(stderr, "Unexpected data after the compressed characters.\n");
+      exit(1);
    }
 
-   fprintf(stderr, "Normal end of file reached\n");
+   if (close_output(&out) != 0 || (output_name != NULL && close(fd_out) != 0)) {
+      fprintf(stderr, "Failure to write the decoded characters.\n");
+      exit(1);
+   }
+   STATS_ADD(STAT_RAW_BYTES, total);
+   STATS_ADD(STAT_PACKED_BYTES, 4 + (input.mapped ? input.len : huff_stats.counters[STAT_READ_BYTES]));
+   free_bit_reader(&br);
+   unmap_input(&input);
+
+   if (verbose) {
+      fprintf(stderr, "Normal end of file reached\n");
+   } else if (verify && !quiet) {
+      fprintf(stderr, "%s: OK\n", argv[optind]);
+   }
 
    // close the input file
    if ((ret = close(fd)) != 0) {
@@ -117,71 +400,227 @@ int main(int argc, char *argv[]) {
    return 0;
 }
 
-void check_magic_num(int fd) {
+int check_magic_num(int fd) {
    // variable declarations
    unsigned char magic_num[4] = {0x4C,0x70,0xF0,0x7C};
-   unsigned char ptr[1] = {0};
-   int i = 0, ret = 0;
+   unsigned char ptr[4] = {0};
+   int i = 0, got = 0, format = FORMAT_LEGACY;
+   long ret = 0;
+
+   // get the magic number in one go, the rest of the input is left to the format's reader
+   while (got < 4 && (ret = read(fd, ptr + got, 4 - got)) > 0) {
+      got += ret;
+   }
+   if (got != 4) {
+      fprintf(stderr, "Failure to read magic number.\n");
+      exit(1);
+   }
 
    // check each magic number character
    for (i = 0; i < 4; i++) {
-      //get the magic number character
-      if ((ret = read(fd, ptr, sizeof(char))) != 1) {
-         fprintf(stderr, "Failure to read magic number.\n");
-         exit(1);
+      // the last byte is 0x7D for the canonical format, 0x7E for the stream
+      // format, 0x7A for a message coded with a dictionary and ARCHIVE_MAGIC
+      // for an archive
+      if (i == 3 && (ptr[i] == 0x7D || ptr[i] == 0x7E || ptr[i] == 0x7A || ptr[i] == ARCHIVE_MAGIC)) {
+         format = (ptr[i] == 0x7D) ? FORMAT_CANONICAL : (ptr[i] == 0x7E) ? FORMAT_STREAM : (ptr[i] == 0x7A) ? FORMAT_DICT : FORMAT_ARCHIVE;
       }
       // compare the magic number from the file with the desired magic number
-      if (*ptr != magic_num[i]) {
-         fprintf(stderr, "Bad magic number in file. 0x%x does not match required 0x%x at byte %d\n", *ptr, magic_num[i], i);
+      else if (ptr[i] != magic_num[i]) {
+         fprintf(stderr, "Bad magic number in file. 0x%x does not match required 0x%x at byte %d\n", ptr[i], magic_num[i], i);
+         exit(1);
+      }
+   }
+
+   return format;
+}
+
+void read_archive(int fd, const char *name, int list, const char *extract, int verify, int threads, FILE *file_out, int quiet) {
+   // variable declarations
+   struct archive_dir dir;
+   struct decode_table table;
+   unsigned long failed = 0, i = 0;
+   long entry = 0;
+   int ret = 0;
+
+   // the footer leads to the directory, the directory to the entries
+   if ((ret = read_directory(fd, &dir)) != HUFF_OK) {
+      fprintf(stderr, "Failed to read the archive's directory: %s.\n", huff_error_string(ret));
+      exit(1);
+   }
+
+   if (list) {
+      // the size of every file, its compressed size and its name
+      for (i = 0; i < dir.count; i++) {
+         printf("%12llu %12llu  %s\n", dir.entries[i].raw_len, dir.entries[i].size, dir.entries[i].name);
+      }
+   } else if (verify) {
+      if ((ret = check_archive(fd, &dir, threads, &failed)) != HUFF_OK) {
+         fprintf(stderr, "Verification of %s failed: %s.\n", dir.entries[failed].name, huff_error_string(ret));
          exit(1);
       }
+      if (!quiet) {
+         fprintf(stderr, "%s: OK, %lu %s\n", name, dir.count, (dir.count == 1) ? "entry" : "entries");
+      }
+   } else if (extract != NULL) {
+      if ((entry = find_entry(&dir, extract)) < 0) {
+         fprintf(stderr, "%s has no entry %s.\n", name, extract);
+         exit(1);
+      }
+      init_decode_table(&table);
+      if ((ret = extract_entry(fd, &dir.entries[entry], file_out, &table)) != HUFF_OK) {
+         fprintf(stderr, "Decompression failed: %s.\n", huff_error_string(ret));
+         exit(1);
+      }
+      free_decode_table(&table);
+   } else {
+      fprintf(stderr, "%s is an archive, --list shows its entries and --extract NAME decodes one.\n", name);
+      exit(1);
    }
 
+   free_directory(&dir);
+
    return;
 }
 
-void get_bit_vector(int fd, unsigned char bit_vector[32]) {
+int load_dict_file(const char *name, struct huff_dict *dict) {
    // variable declarations
-   unsigned char ptr[1] = {0};
-   int i = 0, ret = 0;
+   struct input_file input;
+   int ret = 0;
+
+   if (map_input(name, &input) != 0) {
+      return -1;
+   }
+   ret = load_dict(input.data, input.len, dict);
+   unmap_input(&input);
+
+   return (ret == HUFF_OK) ? 0 : -1;
+}
+
+int decompress_dict_message(int fd, struct huff_dict dicts[], int num_dicts, FILE *file_out) {
+   // variable declarations
+   struct input_file input;
+   unsigned char *msg = NULL, *out = NULL;
+   long id = 0, num = 0, ret = HUFF_ERR_ARGUMENT;
+   int i = 0;
+
+   // the magic number was already read, the message is put back together
+   // behind it so the library sees the whole thing
+   if (map_input_fd(fd, &input) != 0) {
+      return HUFF_ERR_READ;
+   }
+   if ((msg = (unsigned char *)malloc(input.len + 4)) == NULL) {
+      unmap_input(&input);
+      return HUFF_ERR_MEMORY;
+   }
+   msg[0] = 0x4C;
+   msg[1] = 0x70;
+   msg[2] = 0xF0;
+   msg[3] = 0x7A;
+   memcpy(msg + 4, input.data, input.len);
+
+   if ((id = dict_message_id(msg, input.len + 4)) < 0 || (num = dict_message_size(msg, input.len + 4)) < 0) {
+      ret = HUFF_ERR_CORRUPT;
+   } else if ((out = (unsigned char *)malloc(num + 1)) == NULL) {
+      ret = HUFF_ERR_MEMORY;
+   }
+   for (i = 0; out != NULL && i < num_dicts; i++) {
+      if (dicts[i].id == (unsigned long)id) {
+         ret = dict_decompress(&dicts[i], msg, input.len + 4, out, num);
+         if (ret >= 0) {
+            ret = (fwrite(out, sizeof(unsigned char), num, file_out) == (unsigned long)num) ? HUFF_OK : HUFF_ERR_WRITE;
+         }
+         break;
+      }
+   }
+
+   free(out);
+   free(msg);
+   unmap_input(&input);
+
+   return ret;
+}
+
+int parse_range(const char *arg, unsigned long long *start, unsigned long long *len) {
+   // variable declarations
+   char *end = NULL;
+
+   // START:LEN, both counted in characters of the original file
+   *start = strtoull(arg, &end, 10);
+   if (end == arg || *end != ':') {
+      return -1;
+   }
+   arg = end + 1;
+   *len = strtoull(arg, &end, 10);
+   if (end == arg || *end != '\0') {
+      return -1;
+   }
+
+   return 0;
+}
+
+int parse_threads(const char *arg, int *threads) {
+   // variable declarations
+   char *end = NULL;
+   long num = 0;
+
+   // a positive count, more than the pool can run only buys more memory
+   num = strtol(arg, &end, 10);
+   if (end == arg || *end != '\0' || num <= 0) {
+      return -1;
+   }
+   *threads = (num > MAX_THREADS) ? MAX_THREADS : (int)num;
+
+   return 0;
+}
+
+void get_bit_vector(struct bit_reader *br, unsigned char bit_vector[32]) {
+   // variable declarations
+   unsigned char byte = 0;
+   int i = 0;
 
    // for all of the possible characters (ie. 32*8 = 256)
    for (i = 0; i < 32; i++) {
-      // read one byte of the bit vector from the input file
-      if ((ret = read(fd, ptr, sizeof(unsigned char))) != 1) {
-         fprintf(stderr, "Failure to read magic number.\n");
-         exit(1);
-      }
+      // take one byte of the bit vector from the input
+      byte = (unsigned char)get_bits(br, 8);
+
       // reorder the bits and place in the bit vector
-      bit_vector[i] |= ((*ptr & 0x01) << 7);
-      bit_vector[i] |= ((*ptr & 0x02) << 5);
-      bit_vector[i] |= ((*ptr & 0x04) << 3);
-      bit_vector[i] |= ((*ptr & 0x08) << 1);
-      bit_vector[i] |= ((*ptr & 0x10) >> 1);
-      bit_vector[i] |= ((*ptr & 0x20) >> 3);
-      bit_vector[i] |= ((*ptr & 0x40) >> 5);
-      bit_vector[i] |= ((*ptr & 0x80) >> 7);
+      bit_vector[i] |= ((byte & 0x01) << 7);
+      bit_vector[i] |= ((byte & 0x02) << 5);
+      bit_vector[i] |= ((byte & 0x04) << 3);
+      bit_vector[i] |= ((byte & 0x08) << 1);
+      bit_vector[i] |= ((byte & 0x10) >> 1);
+      bit_vector[i] |= ((byte & 0x20) >> 3);
+      bit_vector[i] |= ((byte & 0x40) >> 5);
+      bit_vector[i] |= ((byte & 0x80) >> 7);
+   }
+   if (bit_reader_overrun(br)) {
+      fprintf(stderr, "Failure to read the bit vector.\n");
+      exit(1);
    }
 
    return;
 }
 
-int get_size(int fd) {
+int get_size(struct bit_reader *br) {
    // variable declarations
-   int size = 0, ret = 0;
-   unsigned char *c = (unsigned char *)&size;
+   int size = 0;
 
    // get the size (in bytes 1-4) that the maximum frequency character has
-   if ((ret = read(fd, c, sizeof(unsigned char))) != 1) {
+   size = get_bits(br, 8);
+   if (bit_reader_overrun(br)) {
       fprintf(stderr, "Failure to get the size of the frequency.\n");
       exit(1);
    }
+   if (size > 4) {
+      fprintf(stderr, "Bad frequency size %d in file.\n", size);
+      exit(1);
+   }
 
    return size;
 }
 
-void get_character_counts(int fd, int freq[MAX_CHARS], int num_bytes,
-      unsigned char bit_vector[32], const char *const ASCII[]) {
+void get_character_counts(struct bit_reader *br, int freq[MAX_CHARS], int num_bytes,
+      unsigned char bit_vector[32], const char *const ASCII[], int verbose) {
 
    // variable declarations
    int i = 0;
@@ -190,7 +629,9 @@ void get_character_counts(int fd, int freq[MAX_CHARS], int num_bytes,
    for (i = 0; i < MAX_CHARS; i++) {
       // check if that bit is set in the bit vector - if so, print it to the user and get its frequency
       if ((bit_vector[i/8] >> (i%8)) & 0x01) {
-         if (i < 33) {
+         if (!verbose) {
+            // nothing to show
+         } else if (i < 33) {
             fprintf(stderr, "Character %3s (0x%02x) is in the file\n", ASCII[i], i);
          } else if (i < 127) {
             fprintf(stderr, "Character %3c (0x%x) is in the file\n", i, i);
@@ -200,83 +641,193 @@ void get_character_counts(int fd, int freq[MAX_CHARS], int num_bytes,
             fprintf(stderr, "Character     (0x%x) is in the file\n", i);
          }
 
-         freq[i] = get_freq(fd, num_bytes);
+         freq[i] = get_freq(br, num_bytes);
       }
    }
 
-   fprintf(stderr, "Each char frequency count will be %d %s long\n", num_bytes, (num_bytes == 1) ? "byte" : "bytes");
+   if (verbose) {
+      fprintf(stderr, "Each char frequency count will be %d %s long\n", num_bytes, (num_bytes == 1) ? "byte" : "bytes");
+   }
 
    return;
 }
 
-int get_freq(int fd, int num_bytes) {
+int get_freq(struct bit_reader *br, int num_bytes) {
    // variable declarations
-   int freq = 0, i = 0, ret =0;
-   char *ptr = (char *)&freq;
+   unsigned int freq = 0;
+   int i = 0;
 
+   // loop through the number of bytes specified, most significant byte first
+   for (i = 0; i < num_bytes; i++) {
+      freq = (freq << 8) | get_bits(br, 8);
+   }
+   if (bit_reader_overrun(br)) {
+      fprintf(stderr, "Failure to read the frequency a certain character.\n");
+      exit(1);
+   }
 
-   // loop through the number of bytes specified, creating the frequency of that character
-   for (i = (num_bytes - 1); i >= 0; i--) {
-      // read in the frequency information
-      if ((ret = read(fd, ptr+i, sizeof(char))) != 1) {
-         fprintf(stderr, "Failure to read the frequency a certain character.\n");
-         exit(1);
-      }
+   return (int)freq;
+}
+
+unsigned long get_total(struct bit_reader *br) {
+   // variable declarations
+   unsigned long total = 0;
+   int i = 0;
+
+   // 8 bytes, most significant byte first
+   for (i = 0; i < 8; i++) {
+      total = (total << 8) | get_bits(br, 8);
+   }
+   if (bit_reader_overrun(br)) {
+      fprintf(stderr, "Failure to read the character total.\n");
+      exit(1);
    }
 
-   return freq;
+   return total;
 }
 
-void generate_message(int fd, struct node *tree_head, char code[MAX_CHARS],
-      const char *const ASCII[], int freq[MAX_CHARS]) {
+void get_code_lengths(struct bit_reader *br, int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS],
+      unsigned char bit_vector[32], const char *const ASCII[], int verbose) {
 
-   static int char_count = 0;
-   // the node is a character
-   if (tree_head->ch != -1) {
-      printf("%c", (unsigned char)tree_head->ch);
-
-      if (char_count < 50) {
-         char_count++;
-         freq[tree_head->ch]--;
-         if (tree_head->ch < 33) {
-            fprintf(stderr, "%2d. Translating bits <%s> to character %3s (0x%02x)\n", char_count, code, ASCII[tree_head->ch], tree_head->ch);
-         } else if(tree_head->ch < 127) {
-            fprintf(stderr, "%2d. Translating bits <%s> to character %3c (0x%02x)\n", char_count, code, tree_head->ch, tree_head->ch);
-         } else if(tree_head->ch == 127) {
-            fprintf(stderr, "%2d. Translating bits <%s> to character DEL (0x%02x)\n", char_count, code, tree_head->ch);
+   // variable declarations
+   unsigned char byte = 0;
+   int i = 0, half = 0;
+
+   // print which characters are in the file to the user
+   for (i = 0; i < MAX_CHARS; i++) {
+      // check if that bit is set in the bit vector - if so, print it to the user and get its code length
+      if ((bit_vector[i/8] >> (i%8)) & 0x01) {
+         if (!verbose) {
+            // nothing to show
+         } else if (i < 33) {
+            fprintf(stderr, "Character %3s (0x%02x) is in the file\n", ASCII[i], i);
+         } else if (i < 127) {
+            fprintf(stderr, "Character %3c (0x%x) is in the file\n", i, i);
+         } else if (i == 127) {
+            fprintf(stderr, "Character DEL (0x%x) is in the file\n", i);
+         } else {
+            fprintf(stderr, "Character     (0x%x) is in the file\n", i);
+         }
+
+         // the lengths are packed two to a byte, high nibble first
+         if (half == 0) {
+            byte = (unsigned char)get_bits(br, 8);
+            if (bit_reader_overrun(br)) {
+               fprintf(stderr, "Failure to read the code lengths.\n");
+               exit(1);
+            }
+            lengths[i] = byte >> 4;
          } else {
-            fprintf(stderr, "%2d. Translating bits <%s> to character     (0x%02x)\n", char_count, code, tree_head->ch);
+            lengths[i] = byte & 0x0F;
          }
+         half = !half;
+         freq[i] = 1;
+      }
+   }
+
+   return;
+}
+
+void generate_message(struct bit_reader *br, struct huff_tree *tree, int node, char code[MAX_CODE_BITS + 1],
+      const char *const ASCII[], int freq[MAX_CHARS], struct output_file *out, int verbose, int *traced) {
 
-      } else if(char_count == 50) {
-         char_count++;
+   // the node is a character
+   if (tree->nodes[node].ch != -1) {
+      *output_space(out, 1) = (unsigned char)tree->nodes[node].ch;
+      out->pos++;
+
+      if (verbose < VERBOSE_TRACE) {
+         // no translation to show
+      } else if (*traced < MAX_TRACE) {
+         (*traced)++;
+         freq[tree->nodes[node].ch]--;
+         print_translation(*traced, code, tree->nodes[node].ch, ASCII);
+      } else if (*traced == MAX_TRACE) {
+         (*traced)++;
          fprintf(stderr, "etc...\n");
       }
    } else {  // process through the tree depending on if the next bit is a 0 or 1
-      if (get_bit(fd) == 0) {
-         generate_message(fd, tree_head->p_left, strncat(code, "0", 1), ASCII, freq);
+      if (get_bit(br) == 0) {
+         generate_message(br, tree, tree->nodes[node].left, strcat(code, "0"), ASCII, freq, out, verbose, traced);
       } else {
-         generate_message(fd, tree_head->p_right, strncat(code, "1", 1), ASCII, freq);
+         generate_message(br, tree, tree->nodes[node].right, strcat(code, "1"), ASCII, freq, out, verbose, traced);
       }
    }
 
    return;
 }
 
-int get_bit(int fd) {
-   // both variable are static because they are used to keep track of which bit
-   // is next and what character we are referencing/looking at
-   static int bit_count = 0;
-   static unsigned char ch = '\0';
+int get_bit(struct bit_reader *br) {
+   // the reader keeps track of which bit is next
+   return (int)get_bits(br, 1);
+}
+
+void decode_message(struct bit_reader *br, struct huff_tree *tree, unsigned long total,
+      struct code code_values[MAX_CHARS], const char *const ASCII[], struct output_file *out, int verbose) {
+
+   // variable declarations
+   struct decode_table table;
+   unsigned char *p = NULL;
+   unsigned long remaining = total, num = 0, i = 0;
+   char code[MAX_CODE_BITS + 1] = "";
+   int traced = (verbose == VERBOSE_TRACE) ? 0 : MAX_TRACE + 1;
+
+   init_decode_table(&table);
+   if (build_decode_table(&table, tree) != 0) {
+      fprintf(stderr, "Failure to build the decode table.\n");
+      exit(1);
+   }
+
+   // decode a chunk of characters at a time straight into the output
+   while (remaining > 0) {
+      num = (remaining < OUT_CHUNK) ? remaining : OUT_CHUNK;
+      p = output_space(out, num);
+      decode_symbols(&table, br, p, num);
+
+      // nothing decoded from past the end of the input is written
+      if (bit_reader_overrun(br)) {
+         fprintf(stderr, "The compressed data is truncated.\n");
+         exit(1);
+      }
+
+      // show the user how the first few characters were translated
+      for (i = 0; traced <= MAX_TRACE && i < num; i++) {
+         if (traced++ < MAX_TRACE) {
+            print_translation(traced, code_to_string(&code_values[p[i]], code), p[i], ASCII);
+         } else {
+            fprintf(stderr, "etc...\n");
+         }
+      }
+
+      out->pos += num;
+      if (out->error) {
+         fprintf(stderr, "Failure to write the decoded characters.\n");
+         exit(1);
+      }
+      remaining -= num;
+   }
+
+   free_decode_table(&table);
 
-   // read a new character
-   if (bit_count-- == 0) {
-      read(fd, &ch, sizeof(unsigned char));
-      bit_count = 7;
+   return;
+}
+
+void print_translation(int count, const char *code, int ch, const char *const ASCII[]) {
+   if (ch < 33) {
+      fprintf(stderr, "%2d. Translating bits <%s> to character %3s (0x%02x)\n", count, code, ASCII[ch], ch);
+   } else if(ch < 127) {
+      fprintf(stderr, "%2d. Translating bits <%s> to character %3c (0x%02x)\n", count, code, ch, ch);
+   } else if(ch == 127) {
+      fprintf(stderr, "%2d. Translating bits <%s> to character DEL (0x%02x)\n", count, code, ch);
+   } else {
+      fprintf(stderr, "%2d. Translating bits <%s> to character     (0x%02x)\n", count, code, ch);
    }
 
-   // return the next bit
-   return ((ch >> bit_count) & 0x0001);
+   return;
 }
 
+void print_stats(void) {
+   stats_print(stderr, "dehuffman", 1);
 
+   return;
+}
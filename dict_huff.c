@@ -0,0 +1,229 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      This file is the implementation code for the dictionaries and the
+ *      messages coded with them (see dict_huff.h for the layouts).  The
+ *      codes are the same length limited canonical codes the stream format
+ *      uses, only the table lives in the dictionary instead of the message.
+ *
+ ***************************/
+
+#include <stdlib.h>  // NULL
+
+#include "huff.h"
+#include "dict_huff.h"
+#include "stats_huff.h"
+
+// function prototypes
+static unsigned long hash_lengths(const unsigned char *p, unsigned long len);
+static long read_message_header(const unsigned char *in, unsigned long len, unsigned long *id, unsigned long *num);
+
+void train_dict(int freq[MAX_CHARS], unsigned char out[DICT_SIZE]) {
+
+   // variable declarations
+   int counts[MAX_CHARS], i = 0;
+   unsigned char lengths[MAX_CHARS];
+   unsigned long id = 0;
+
+   // every character gets a code, the ones the sample never had get long ones
+   for (i = 0; i < MAX_CHARS; i++) {
+      counts[i] = freq[i] + 1;
+   }
+   generate_code_lengths(counts, lengths, CANONICAL_MAX_LEN);
+
+   for (i = 0; i < MAX_CHARS; i += 2) {
+      out[8 + i / 2] = (unsigned char)((lengths[i] << 4) | lengths[i + 1]);
+   }
+   id = hash_lengths(out + 8, MAX_CHARS / 2);
+
+   out[0] = 0x4C;
+   out[1] = 0x70;
+   out[2] = 0xF0;
+   out[3] = 0x7B;
+   out[4] = (unsigned char)(id >> 24);
+   out[5] = (unsigned char)(id >> 16);
+   out[6] = (unsigned char)(id >> 8);
+   out[7] = (unsigned char)id;
+
+   return;
+}
+
+int load_dict(const unsigned char *in, unsigned long len, struct huff_dict *dict) {
+
+   // variable declarations
+   int freq[MAX_CHARS], i = 0;
+   struct code code_values[MAX_CHARS] = {{-1, 0, 0}};
+   struct huff_tree tree;
+
+   init_decode_table(&dict->decode);
+
+   if (len != DICT_SIZE || in[0] != 0x4C || in[1] != 0x70 || in[2] != 0xF0 || in[3] != 0x7B) {
+      return HUFF_ERR_CORRUPT;
+   }
+   dict->id = ((unsigned long)in[4] << 24) | ((unsigned long)in[5] << 16) | ((unsigned long)in[6] << 8) | in[7];
+   if (dict->id != hash_lengths(in + 8, MAX_CHARS / 2)) {
+      return HUFF_ERR_CORRUPT;
+   }
+
+   for (i = 0; i < MAX_CHARS; i += 2) {
+      dict->lengths[i] = in[8 + i / 2] >> 4;
+      dict->lengths[i + 1] = in[8 + i / 2] & 0x0F;
+      freq[i] = 1;
+      freq[i + 1] = 1;
+   }
+   if (valid_code_lengths(freq, dict->lengths) == 0) {
+      return HUFF_ERR_CORRUPT;
+   }
+
+   // both tables are built once here and only read by the calls
+   build_canonical_codes(freq, dict->lengths, code_values);
+   build_encode_table(&dict->encode, code_values);
+   if (generate_code_tree(&tree, code_values) != 0) {
+      return HUFF_ERR_CORRUPT;
+   }
+   if (build_decode_table(&dict->decode, &tree) != 0) {
+      return HUFF_ERR_MEMORY;
+   }
+   if (dict->decode.short_codes && build_multi_table(&dict->decode) != 0) {
+      return HUFF_ERR_MEMORY;
+   }
+
+   return HUFF_OK;
+}
+
+void free_dict(struct huff_dict *dict) {
+   free_decode_table(&dict->decode);
+
+   return;
+}
+
+long dict_compress(struct huff_dict *dict, const unsigned char *in, unsigned long len,
+      unsigned char *out, unsigned long cap) {
+
+   // variable declarations
+   unsigned char *p = out;
+   unsigned long num = len;
+   struct bit_writer bw;
+
+   if (cap < DICT_BOUND(len)) {
+      return HUFF_ERR_SPACE;
+   }
+
+   p[0] = 0x4C;
+   p[1] = 0x70;
+   p[2] = 0xF0;
+   p[3] = 0x7A;
+   p[4] = (unsigned char)(dict->id >> 24);
+   p[5] = (unsigned char)(dict->id >> 16);
+   p[6] = (unsigned char)(dict->id >> 8);
+   p[7] = (unsigned char)dict->id;
+   p += 8;
+
+   // the character count takes as few bytes as it needs
+   while (num >= 0x80) {
+      *p++ = (unsigned char)(num | 0x80);
+      num >>= 7;
+   }
+   *p++ = (unsigned char)num;
+
+   init_bit_writer_mem(&bw, p, cap - (p - out));
+   encode_symbols(&dict->encode, in, len, &bw);
+   align_bits(&bw);
+   if (bw.error) {
+      return HUFF_ERR_SPACE;
+   }
+   STATS_ADD(STAT_RAW_BYTES, len);
+   STATS_ADD(STAT_PACKED_BYTES, (p - out) + bw.pos);
+
+   return (p - out) + bw.pos;
+}
+
+long dict_message_id(const unsigned char *in, unsigned long len) {
+   // variable declarations
+   unsigned long id = 0, num = 0;
+   long ret = read_message_header(in, len, &id, &num);
+
+   return (ret < 0) ? ret : (long)id;
+}
+
+long dict_message_size(const unsigned char *in, unsigned long len) {
+   // variable declarations
+   unsigned long id = 0, num = 0;
+   long ret = read_message_header(in, len, &id, &num);
+
+   return (ret < 0) ? ret : (long)num;
+}
+
+long dict_decompress(struct huff_dict *dict, const unsigned char *in, unsigned long len,
+      unsigned char *out, unsigned long cap) {
+
+   // variable declarations
+   unsigned long id = 0, num = 0;
+   long pos = 0;
+   struct bit_reader br;
+
+   if ((pos = read_message_header(in, len, &id, &num)) < 0) {
+      return pos;
+   }
+   if (id != dict->id) {
+      return HUFF_ERR_ARGUMENT;
+   }
+   if (cap < num) {
+      return HUFF_ERR_SPACE;
+   }
+
+   // every code takes at least a bit
+   if (num > (len - pos) * 8) {
+      return HUFF_ERR_CORRUPT;
+   }
+
+   init_bit_reader_mem(&br, in + pos, len - pos);
+   decode_symbols(&dict->decode, &br, out, num);
+
+   // the codes must end in the last byte of the message
+   if (bit_reader_overrun(&br) || !bit_reader_at_end(&br)) {
+      return HUFF_ERR_CORRUPT;
+   }
+   STATS_ADD(STAT_RAW_BYTES, num);
+   STATS_ADD(STAT_PACKED_BYTES, len);
+
+   return num;
+}
+
+static unsigned long hash_lengths(const unsigned char *p, unsigned long len) {
+   // variable declarations
+   unsigned long hash = 2166136261ul, i = 0;
+
+   // 32 bit FNV-1a
+   for (i = 0; i < len; i++) {
+      hash = ((hash ^ p[i]) * 16777619ul) & 0xFFFFFFFFul;
+   }
+
+   return hash;
+}
+
+static long read_message_header(const unsigned char *in, unsigned long len, unsigned long *id, unsigned long *num) {
+   // variable declarations
+   unsigned long pos = 8;
+   int shift = 0;
+
+   if (len < 9 || in[0] != 0x4C || in[1] != 0x70 || in[2] != 0xF0 || in[3] != 0x7A) {
+      return HUFF_ERR_CORRUPT;
+   }
+   *id = ((unsigned long)in[4] << 24) | ((unsigned long)in[5] << 16) | ((unsigned long)in[6] << 8) | in[7];
+
+   // at most 5 bytes of count, 7 bits at a time
+   *num = 0;
+   do {
+      if (pos == len || shift > 28) {
+         return HUFF_ERR_CORRUPT;
+      }
+      *num |= (unsigned long)(in[pos] & 0x7F) << shift;
+      shift += 7;
+   } while (in[pos++] & 0x80);
+
+   return pos;
+}
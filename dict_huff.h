@@ -0,0 +1,61 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      Shared code tables for small messages.  A message of a few hundred
+ *      characters cannot carry its own table and still come out smaller, so
+ *      the table is trained once from a sample of similar messages, saved
+ *      as a dictionary and referred to by its id.  Every character gets a
+ *      code, ones missing from the sample included, so any message can be
+ *      coded with any dictionary.  A loaded dictionary keeps its encode and
+ *      decode tables ready and is only read by the calls, so it can be
+ *      shared by threads.
+ *
+ *      Dictionary (DICT_SIZE bytes):
+ *
+ *         magic number   4 bytes   0x4C 0x70 0xF0 0x7B
+ *         id             4 bytes   FNV-1a hash of the code lengths
+ *         code lengths   128 bytes 4 bits for every character, high nibble first
+ *
+ *      Message:
+ *
+ *         magic number   4 bytes   0x4C 0x70 0xF0 0x7A
+ *         id             4 bytes   the dictionary the message was coded with
+ *         characters     1 to 5 bytes, 7 bits a byte starting with the low
+ *                        bits, the high bit is set while more bytes follow
+ *         payload        the canonical codes, first bit in the high bit
+ *
+ ***************************/
+
+#ifndef HUFFMAN_DICT
+#define HUFFMAN_DICT
+
+#include "tree_huff.h"
+#include "encode_huff.h"
+#include "decode_huff.h"
+
+#define DICT_SIZE        (8 + MAX_CHARS / 2)
+#define DICT_HEADER_MAX  (8 + 5)
+
+// largest a message of len characters can get
+#define DICT_BOUND(len) (DICT_HEADER_MAX + ((unsigned long)(len) * CANONICAL_MAX_LEN + 7) / 8 + 8)
+
+struct huff_dict {
+   unsigned long id;
+   unsigned char lengths[MAX_CHARS];
+   struct encode_table encode;
+   struct decode_table decode;
+};
+
+// function prototypes
+void train_dict(int freq[MAX_CHARS], unsigned char out[DICT_SIZE]);
+int  load_dict(const unsigned char *in, unsigned long len, struct huff_dict *dict);
+void free_dict(struct huff_dict *dict);
+long dict_compress(struct huff_dict *dict, const unsigned char *in, unsigned long len, unsigned char *out, unsigned long cap);
+long dict_message_id(const unsigned char *in, unsigned long len);
+long dict_message_size(const unsigned char *in, unsigned long len);
+long dict_decompress(struct huff_dict *dict, const unsigned char *in, unsigned long len, unsigned char *out, unsigned long cap);
+
+#endif //HUFFMAN_DICT
@@ -0,0 +1,490 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      This file is the implementation code for the huffman encoder and the
+ *      character counting that comes before it.  Every character's code is
+ *      appended to a 64-bit accumulator.  When the next code does not fit,
+ *      the whole bytes of the accumulator are stored as one word into the
+ *      output buffer.  The bit order is the same as the original string based
+ *      packing (first code bit in the most significant bit of the byte, last
+ *      byte padded with zeros) so the output is unchanged.  Tables whose
+ *      codes are short enough go through kernels instantiated for their
+ *      longest code, which flush once per fixed number of characters
+ *      instead of checking for room before every code.  The four stream
+ *      kernel runs the four accumulators through one unrolled loop and
+ *      flushes them without a branch: the whole word is stored, the
+ *      pointer moves past its complete bytes and they are shifted out.
+ *      The caller's buffers are checked once for the most the codes can
+ *      take beforehand.
+ *
+ ***************************/
+
+#include <string.h>  // memcpy(), memset()
+
+#include "encode_huff.h"
+#include "pool_huff.h"
+#include "stats_huff.h"
+
+#define PARALLEL_COUNT_MIN (1ul << 24)
+
+// characters whose codes always fit in the 56 bits a flush leaves free
+// when no code is longer than len, which keeps the accumulator under 64
+// bits for the branchless flush
+#define FLUSH_SYMBOLS(len) (56 / (len))
+
+// store the accumulator whole, keep its complete bytes and shift them out
+#define FLUSH_WORD(p, acc, count) \
+   (p)[0] = (unsigned char)((acc) >> 56); \
+   (p)[1] = (unsigned char)((acc) >> 48); \
+   (p)[2] = (unsigned char)((acc) >> 40); \
+   (p)[3] = (unsigned char)((acc) >> 32); \
+   (p)[4] = (unsigned char)((acc) >> 24); \
+   (p)[5] = (unsigned char)((acc) >> 16); \
+   (p)[6] = (unsigned char)((acc) >> 8); \
+   (p)[7] = (unsigned char)(acc); \
+   (p) += (count) >> 3; \
+   (acc) <<= (count) & 56; \
+   (count) &= 7;
+
+// append the code of table entry e
+#define PUT_CODE(acc, count, e) \
+   (acc) |= ((e) & ~CODE_LEN_MASK) >> (count); \
+   (count) += (int)((e) & CODE_LEN_MASK);
+
+// one worker's share of the histogram
+struct count_part {
+   struct job job;
+   const unsigned char *in;
+   unsigned long len;
+   int freq[MAX_CHARS];
+};
+
+// function prototypes
+static void count_piece(void *arg);
+KERNEL void encode_run(const struct encode_table *table, int max_len, const unsigned char *in, unsigned long len, struct bit_writer *bw);
+KERNEL void encode_run4(const struct encode_table *table, int max_len, const unsigned char *in, unsigned long len, unsigned long seg, struct bit_writer bw[4]);
+KERNEL void encode_run_context(const struct encode_table tables[], const unsigned char map[MAX_CHARS], int max_len, const unsigned char *in, unsigned long len, struct bit_writer *bw);
+
+void init_bit_writer(struct bit_writer *bw, struct output_file *out) {
+
+   // the bits go straight into the buffers of an output from open_output()
+   bw->out = out;
+   bw->buf = out->buf;
+   bw->pos = 0;
+   bw->cap = out->cap;
+   bw->acc = 0;
+   bw->count = 0;
+   bw->error = 0;
+
+   return;
+}
+
+void init_bit_writer_mem(struct bit_writer *bw, unsigned char *buf, unsigned long cap) {
+
+   bw->out = NULL;
+   bw->buf = buf;
+   bw->pos = 0;
+   bw->cap = cap;
+   bw->acc = 0;
+   bw->count = 0;
+   bw->error = 0;
+
+   return;
+}
+
+void flush_bits(struct bit_writer *bw) {
+   // variable declarations
+   unsigned char *p = bw->buf + bw->pos;
+   int bytes = bw->count >> 3;
+
+   // store the whole accumulator, only the complete bytes are kept
+   p[0] = (unsigned char)(bw->acc >> 56);
+   p[1] = (unsigned char)(bw->acc >> 48);
+   p[2] = (unsigned char)(bw->acc >> 40);
+   p[3] = (unsigned char)(bw->acc >> 32);
+   p[4] = (unsigned char)(bw->acc >> 24);
+   p[5] = (unsigned char)(bw->acc >> 16);
+   p[6] = (unsigned char)(bw->acc >> 8);
+   p[7] = (unsigned char)bw->acc;
+   bw->pos += bytes;
+   bw->acc = (bytes == 8) ? 0 : (bw->acc << (bytes * 8));
+   bw->count &= 7;
+
+   // keep room for one more word in the buffer, a full one goes to the
+   // writer thread, a caller's buffer cannot be emptied so running out of
+   // it is an error
+   if (bw->pos > bw->cap - 8) {
+      if (bw->out == NULL) {
+         bw->error = 1;
+         bw->pos = bw->cap - 8;
+      } else {
+         bw->out->pos = bw->pos;
+         if (flush_output(bw->out) != 0) {
+            bw->error = 1;
+         }
+         bw->buf = bw->out->buf;
+         bw->pos = 0;
+      }
+   }
+
+   return;
+}
+
+void align_bits(struct bit_writer *bw) {
+
+   // store the remaining bits, the last byte is padded with zeros
+   flush_bits(bw);
+   if (bw->count > 0) {
+      bw->buf[bw->pos++] = (unsigned char)(bw->acc >> 56);
+      bw->acc = 0;
+      bw->count = 0;
+   }
+
+   return;
+}
+
+int finish_bit_writer(struct bit_writer *bw) {
+   // variable declarations
+   int ret = 0;
+
+   // hand the remaining bits to the output, closing it writes them out
+   align_bits(bw);
+
+   bw->out->pos = bw->pos;
+   if (flush_output(bw->out) != 0) {
+      bw->error = 1;
+   }
+   bw->pos = 0;
+   bw->buf = NULL;
+
+   ret = bw->error ? -1 : 0;
+
+   return ret;
+}
+
+void build_encode_table(struct encode_table *table, struct code code_values[MAX_CHARS]) {
+   // variable declarations
+   int i = 0;
+
+   STATS_BEGIN(PHASE_CODES);
+   table->max_len = 0;
+
+   // unused characters and a lone character's empty code stay zero
+   for (i = 0; i < MAX_CHARS; i++) {
+      table->code[i] = 0;
+      if (code_values[i].len > 0) {
+         table->code[i] = ((unsigned long long)code_values[i].bits << (64 - code_values[i].len)) | code_values[i].len;
+      }
+      if (code_values[i].len > table->max_len) {
+         table->max_len = code_values[i].len;
+      }
+   }
+   STATS_END();
+
+   return;
+}
+
+void encode_symbols(struct encode_table *table, const unsigned char *in, unsigned long len,
+      struct bit_writer *bw) {
+
+   // a lone character has an empty code, there is nothing to write
+   STATS_ADD(STAT_SYMBOLS, len);
+   if (table->max_len == 0) {
+      return;
+   }
+
+   // pick the kernel for the longest code, the legacy format's codes can
+   // be far longer than any of them handle
+   STATS_BEGIN(PHASE_ENCODE);
+   if (table->max_len <= 8) {
+      encode_run(table, 8, in, len, bw);
+   } else if (table->max_len <= 11) {
+      encode_run(table, 11, in, len, bw);
+   } else if (table->max_len <= CANONICAL_MAX_LEN) {
+      encode_run(table, CANONICAL_MAX_LEN, in, len, bw);
+   } else {
+      encode_run(table, 0, in, len, bw);
+   }
+   STATS_END();
+
+   return;
+}
+
+void encode_symbols4(struct encode_table *table, const unsigned char *in, unsigned long len, unsigned long seg,
+      struct bit_writer bw[4]) {
+
+   // variable declarations
+   int i = 0, room = 1;
+
+   STATS_ADD(STAT_SYMBOLS, len);
+   if (table->max_len == 0) {
+      return;
+   }
+
+   // stream i codes the characters from i * seg, the last one takes what
+   // is left.  The kernels store without looking, so every buffer must
+   // hold the most its segment's codes can come to and a word
+   for (i = 0; i < 4; i++) {
+      room &= (bw[i].cap - bw[i].pos >= (seg * table->max_len + 7) / 8 + 16);
+   }
+
+   STATS_BEGIN(PHASE_ENCODE);
+   if (!room || table->max_len > CANONICAL_MAX_LEN) {
+      encode_run4(table, 0, in, len, seg, bw);
+   } else if (table->max_len <= 8) {
+      encode_run4(table, 8, in, len, seg, bw);
+   } else if (table->max_len <= 11) {
+      encode_run4(table, 11, in, len, seg, bw);
+   } else {
+      encode_run4(table, CANONICAL_MAX_LEN, in, len, seg, bw);
+   }
+   STATS_END();
+
+   return;
+}
+
+void encode_symbols_context(struct encode_table tables[], const unsigned char map[MAX_CHARS],
+      const unsigned char *in, unsigned long len, struct bit_writer *bw) {
+
+   // variable declarations
+   int max_len = 0, i = 0;
+
+   // the longest code of the groups any character maps to
+   for (i = 0; i < MAX_CHARS; i++) {
+      if (tables[map[i]].max_len > max_len) {
+         max_len = tables[map[i]].max_len;
+      }
+   }
+
+   STATS_ADD(STAT_SYMBOLS, len);
+   STATS_BEGIN(PHASE_ENCODE);
+   if (max_len <= 8) {
+      encode_run_context(tables, map, 8, in, len, bw);
+   } else if (max_len <= 11) {
+      encode_run_context(tables, map, 11, in, len, bw);
+   } else if (max_len <= CANONICAL_MAX_LEN) {
+      encode_run_context(tables, map, CANONICAL_MAX_LEN, in, len, bw);
+   } else {
+      encode_run_context(tables, map, 0, in, len, bw);
+   }
+   STATS_END();
+
+   return;
+}
+
+void count_characters(const unsigned char *in, unsigned long len, int freq[MAX_CHARS]) {
+   // variable declarations
+   unsigned int counts[4][MAX_CHARS];
+   unsigned long long a = 0, b = 0;
+   unsigned long i = 0;
+   int c = 0;
+
+   STATS_BEGIN(PHASE_HISTOGRAM);
+   memset(counts, 0, sizeof(counts));
+
+   // two words per pass spread over four tables, so runs of the same
+   // character do not wait on their own previous increment
+   for (i = 0; i + 16 <= len; i += 16) {
+      memcpy(&a, in + i, 8);
+      memcpy(&b, in + i + 8, 8);
+      counts[0][a & 0xFF]++;
+      counts[1][(a >> 8) & 0xFF]++;
+      counts[2][(a >> 16) & 0xFF]++;
+      counts[3][(a >> 24) & 0xFF]++;
+      counts[0][(a >> 32) & 0xFF]++;
+      counts[1][(a >> 40) & 0xFF]++;
+      counts[2][(a >> 48) & 0xFF]++;
+      counts[3][a >> 56]++;
+      counts[0][b & 0xFF]++;
+      counts[1][(b >> 8) & 0xFF]++;
+      counts[2][(b >> 16) & 0xFF]++;
+      counts[3][(b >> 24) & 0xFF]++;
+      counts[0][(b >> 32) & 0xFF]++;
+      counts[1][(b >> 40) & 0xFF]++;
+      counts[2][(b >> 48) & 0xFF]++;
+      counts[3][b >> 56]++;
+   }
+   for (; i < len; i++) {
+      counts[0][in[i]]++;
+   }
+
+   // merge the tables into the running counts
+   for (c = 0; c < MAX_CHARS; c++) {
+      freq[c] += counts[0][c] + counts[1][c] + counts[2][c] + counts[3][c];
+   }
+   STATS_END();
+
+   return;
+}
+
+void count_characters_threads(const unsigned char *in, unsigned long len, int freq[MAX_CHARS], int threads) {
+   // variable declarations
+   struct count_part parts[MAX_THREADS];
+   struct pool *pool = NULL;
+   unsigned long piece = 0;
+   int i = 0, c = 0;
+
+   // small inputs are not worth waking the workers for
+   if (threads > MAX_THREADS) {
+      threads = MAX_THREADS;
+   }
+   if (threads <= 1 || len < PARALLEL_COUNT_MIN || (pool = create_pool(threads)) == NULL) {
+      count_characters(in, len, freq);
+      return;
+   }
+
+   // every worker counts its own piece into its own table
+   piece = len / threads;
+   for (i = 0; i < threads; i++) {
+      parts[i].in = in + i * piece;
+      parts[i].len = (i == threads - 1) ? len - i * piece : piece;
+      memset(parts[i].freq, 0, sizeof(parts[i].freq));
+      submit_job(pool, &parts[i].job, count_piece, &parts[i]);
+   }
+
+   for (i = 0; i < threads; i++) {
+      wait_job(pool, &parts[i].job);
+      for (c = 0; c < MAX_CHARS; c++) {
+         freq[c] += parts[i].freq[c];
+      }
+   }
+
+   destroy_pool(pool);
+
+   return;
+}
+
+static void count_piece(void *arg) {
+   // variable declarations
+   struct count_part *part = (struct count_part *)arg;
+
+   count_characters(part->in, part->len, part->freq);
+
+   return;
+}
+
+// the kernels take max_len as the longest code of the table, or 0 for any
+// table, which checks for room before every code.  The accumulator is kept
+// in locals between the flushes
+KERNEL void encode_run(const struct encode_table *table, int max_len, const unsigned char *in,
+      unsigned long len, struct bit_writer *bw) {
+
+   // variable declarations
+   unsigned long long acc = 0, e = 0;
+   unsigned long i = 0;
+   int count = 0, k = 0;
+
+   if (max_len > 0) {
+      for (; i + FLUSH_SYMBOLS(max_len) <= len; i += FLUSH_SYMBOLS(max_len)) {
+         flush_bits(bw);
+         acc = bw->acc;
+         count = bw->count;
+         for (k = 0; k < FLUSH_SYMBOLS(max_len); k++) {
+            e = table->code[in[i + k]];
+            PUT_CODE(acc, count, e);
+         }
+         bw->acc = acc;
+         bw->count = count;
+      }
+   }
+   for (; i < len; i++) {
+      put_code(bw, table->code[in[i]]);
+   }
+
+   return;
+}
+
+// the four streams as far as the last (shortest) one goes, then what is
+// left of the first three.  max_len 0 codes every character with a check
+// for room, as with encode_run()
+KERNEL void encode_run4(const struct encode_table *table, int max_len, const unsigned char *in,
+      unsigned long len, unsigned long seg, struct bit_writer bw[4]) {
+
+   // variable declarations
+   const unsigned char *in0 = in, *in1 = in + seg, *in2 = in + 2 * seg, *in3 = in + 3 * seg;
+   unsigned char *p0 = bw[0].buf + bw[0].pos, *p1 = bw[1].buf + bw[1].pos, *p2 = bw[2].buf + bw[2].pos, *p3 = bw[3].buf + bw[3].pos;
+   unsigned long long acc0 = bw[0].acc, acc1 = bw[1].acc, acc2 = bw[2].acc, acc3 = bw[3].acc, e0 = 0, e1 = 0, e2 = 0, e3 = 0;
+   unsigned long last = (len > 3 * seg) ? len - 3 * seg : 0, i = 0, j = 0, start = 0, num = 0;
+   int count0 = bw[0].count, count1 = bw[1].count, count2 = bw[2].count, count3 = bw[3].count, s = 0, k = 0;
+
+   if (max_len > 0) {
+      for (; i + FLUSH_SYMBOLS(max_len) <= last; i += FLUSH_SYMBOLS(max_len)) {
+         FLUSH_WORD(p0, acc0, count0);
+         FLUSH_WORD(p1, acc1, count1);
+         FLUSH_WORD(p2, acc2, count2);
+         FLUSH_WORD(p3, acc3, count3);
+         for (k = 0; k < FLUSH_SYMBOLS(max_len); k++) {
+            e0 = table->code[in0[i + k]];
+            e1 = table->code[in1[i + k]];
+            e2 = table->code[in2[i + k]];
+            e3 = table->code[in3[i + k]];
+            PUT_CODE(acc0, count0, e0);
+            PUT_CODE(acc1, count1, e1);
+            PUT_CODE(acc2, count2, e2);
+            PUT_CODE(acc3, count3, e3);
+         }
+      }
+   }
+   bw[0].pos = p0 - bw[0].buf;
+   bw[1].pos = p1 - bw[1].buf;
+   bw[2].pos = p2 - bw[2].buf;
+   bw[3].pos = p3 - bw[3].buf;
+   bw[0].acc = acc0;
+   bw[1].acc = acc1;
+   bw[2].acc = acc2;
+   bw[3].acc = acc3;
+   bw[0].count = count0;
+   bw[1].count = count1;
+   bw[2].count = count2;
+   bw[3].count = count3;
+
+   // the rest a code at a time, short inputs can leave streams before the
+   // last one short or empty too
+   for (s = 0; s < 4; s++) {
+      start = (len > s * seg) ? s * seg : len;
+      num = (len - start < seg) ? len - start : seg;
+      for (j = i; j < num; j++) {
+         put_code(&bw[s], table->code[in[start + j]]);
+      }
+   }
+
+   return;
+}
+
+KERNEL void encode_run_context(const struct encode_table tables[], const unsigned char map[MAX_CHARS], int max_len,
+      const unsigned char *in, unsigned long len, struct bit_writer *bw) {
+
+   // variable declarations
+   const struct encode_table *table = &tables[map[0]];
+   unsigned long long acc = 0, e = 0;
+   unsigned long i = 0;
+   int count = 0, c = 0, k = 0;
+
+   // every character is coded with the table of the character before it,
+   // the first one with the table of a zero
+   if (max_len > 0) {
+      for (; i + FLUSH_SYMBOLS(max_len) <= len; i += FLUSH_SYMBOLS(max_len)) {
+         flush_bits(bw);
+         acc = bw->acc;
+         count = bw->count;
+         for (k = 0; k < FLUSH_SYMBOLS(max_len); k++) {
+            c = in[i + k];
+            e = table->code[c];
+            PUT_CODE(acc, count, e);
+            table = &tables[map[c]];
+         }
+         bw->acc = acc;
+         bw->count = count;
+      }
+   }
+   for (; i < len; i++) {
+      c = in[i];
+      put_code(bw, table->code[c]);
+      table = &tables[map[c]];
+   }
+
+   return;
+}
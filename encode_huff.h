@@ -0,0 +1,64 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      Word at a time huffman encoding.  Each code is kept left aligned in a
+ *      word with its length in the low bits, so a character takes one load,
+ *      codes are collected in a 64-bit accumulator and whole words of it are
+ *      flushed into a large output buffer.  The four streams of a block are
+ *      coded together, each with its own accumulator, so their codes do not
+ *      wait on each other.
+ *
+ ***************************/
+
+#ifndef HUFFMAN_ENCODE
+#define HUFFMAN_ENCODE
+
+#include "tree_huff.h"
+#include "io_huff.h"
+
+struct bit_writer {
+   struct output_file *out;      // NULL when writing into a caller's buffer
+   unsigned char *buf;
+   unsigned long pos;
+   unsigned long cap;
+   unsigned long long acc;       // pending bits, msb first
+   int count;                    // number of pending bits in the accumulator
+   int error;
+};
+
+// the length of a code in its table entry, the code itself is above it
+#define CODE_LEN_MASK 63ull
+
+struct encode_table {
+   unsigned long long code[MAX_CHARS];   // code left aligned in the word, length in the low 6 bits
+   int max_len;                          // zero when the only character has an empty code
+};
+
+// function prototypes
+void init_bit_writer(struct bit_writer *bw, struct output_file *out);
+void init_bit_writer_mem(struct bit_writer *bw, unsigned char *buf, unsigned long cap);
+int  finish_bit_writer(struct bit_writer *bw);
+void flush_bits(struct bit_writer *bw);
+void align_bits(struct bit_writer *bw);
+void build_encode_table(struct encode_table *table, struct code code_values[MAX_CHARS]);
+void encode_symbols(struct encode_table *table, const unsigned char *in, unsigned long len, struct bit_writer *bw);
+void encode_symbols4(struct encode_table *table, const unsigned char *in, unsigned long len, unsigned long seg, struct bit_writer bw[4]);
+void encode_symbols_context(struct encode_table tables[], const unsigned char map[MAX_CHARS], const unsigned char *in, unsigned long len, struct bit_writer *bw);
+void count_characters(const unsigned char *in, unsigned long len, int freq[MAX_CHARS]);
+void count_characters_threads(const unsigned char *in, unsigned long len, int freq[MAX_CHARS], int threads);
+
+// append a table entry's code, codes are at most 57 bits since the
+// frequencies are ints.  The accumulator is flushed before it could hold
+// 64 bits, so the code is never shifted by a whole word
+static inline void put_code(struct bit_writer *bw, unsigned long long code) {
+   if (bw->count + (int)(code & CODE_LEN_MASK) > 63) {
+      flush_bits(bw);
+   }
+   bw->acc |= (code & ~CODE_LEN_MASK) >> bw->count;
+   bw->count += (int)(code & CODE_LEN_MASK);
+}
+
+#endif //HUFFMAN_ENCODE
@@ -0,0 +1,183 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      This file is the implementation code for the library interface.  The
+ *      work is done by the block functions in block_huff.c, this only checks
+ *      the arguments and supplies the context's tables.
+ *
+ ***************************/
+
+#include <stdlib.h>  // malloc(), free()
+
+#include "huff.h"
+#include "block_huff.h"
+#include "encode_huff.h"
+
+int huff_init(struct huff_ctx *ctx) {
+
+   ctx->block_size = DEFAULT_BLOCK_SIZE;
+   ctx->streams = 1;
+   ctx->split = 0;
+   ctx->context = 0;
+   ctx->checksum = 1;
+   ctx->sample = 0;
+   ctx->scratch = NULL;
+   ctx->scratch_cap = 0;
+   init_decode_table(&ctx->table);
+
+   // a primary table is needed for every block, have it ready
+   if ((ctx->table.entries = (struct decode_entry *)malloc((1u << DECODE_BITS) * sizeof(struct decode_entry))) == NULL) {
+      return HUFF_ERR_MEMORY;
+   }
+   ctx->table.cap = 1u << DECODE_BITS;
+
+   return HUFF_OK;
+}
+
+void huff_free(struct huff_ctx *ctx) {
+   free_decode_table(&ctx->table);
+   free(ctx->scratch);
+   ctx->scratch = NULL;
+
+   return;
+}
+
+unsigned long huff_compress_bound(const struct huff_ctx *ctx, unsigned long len) {
+   return STREAM_BOUND(len, SPLIT_UNIT(ctx->block_size, ctx->split));
+}
+
+long huff_compress(struct huff_ctx *ctx, const unsigned char *src, unsigned long len,
+      unsigned char *dst, unsigned long cap) {
+
+   if (ctx->block_size < MIN_BLOCK_SIZE || ctx->block_size > MAX_BLOCK_SIZE ||
+         (ctx->streams != 1 && ctx->streams != 4) || ctx->split < 0 || ctx->split > MAX_SPLIT_LEVEL) {
+      return HUFF_ERR_ARGUMENT;
+   }
+
+   return compress_buffer(src, len, dst, cap, ctx->block_size, ctx->streams, ctx->split, ctx->context, ctx->checksum, ctx->sample);
+}
+
+long huff_decompressed_size(const unsigned char *src, unsigned long len) {
+   return stream_raw_size(src, len);
+}
+
+long huff_decompress(struct huff_ctx *ctx, const unsigned char *src, unsigned long len,
+      unsigned char *dst, unsigned long cap) {
+
+   return decompress_buffer(src, len, dst, cap, &ctx->table);
+}
+
+long huff_decompress_range(struct huff_ctx *ctx, const unsigned char *src, unsigned long len, unsigned long long start,
+      unsigned char *dst, unsigned long count) {
+
+   return decompress_range_buffer(src, len, start, dst, count, &ctx->table, &ctx->scratch, &ctx->scratch_cap);
+}
+
+void huff_push_init(struct huff_push *push) {
+   init_push(push);
+
+   return;
+}
+
+int huff_push(struct huff_push *push, const unsigned char *src, unsigned long len, unsigned long *used,
+      unsigned char *dst, unsigned long cap, unsigned long *written) {
+
+   return push_stream(push, src, len, used, dst, cap, written);
+}
+
+void huff_push_free(struct huff_push *push) {
+   free_push(push);
+
+   return;
+}
+
+long huff_dict_train(const unsigned char *src, unsigned long len, unsigned char *dst, unsigned long cap) {
+   // variable declarations
+   int freq[MAX_CHARS] = {0};
+
+   if (cap < DICT_SIZE) {
+      return HUFF_ERR_SPACE;
+   }
+
+   // the samples are counted as one
+   count_characters(src, len, freq);
+   train_dict(freq, dst);
+
+   return DICT_SIZE;
+}
+
+int huff_dict_load(struct huff_dict *dict, const unsigned char *data, unsigned long len) {
+   return load_dict(data, len, dict);
+}
+
+void huff_dict_free(struct huff_dict *dict) {
+   free_dict(dict);
+
+   return;
+}
+
+unsigned long huff_dict_bound(unsigned long len) {
+   return DICT_BOUND(len);
+}
+
+long huff_dict_compress(struct huff_dict *dict, const unsigned char *src, unsigned long len,
+      unsigned char *dst, unsigned long cap) {
+
+   return dict_compress(dict, src, len, dst, cap);
+}
+
+long huff_dict_id(const unsigned char *src, unsigned long len) {
+   return dict_message_id(src, len);
+}
+
+long huff_dict_decompressed_size(const unsigned char *src, unsigned long len) {
+   return dict_message_size(src, len);
+}
+
+long huff_dict_decompress(struct huff_dict *dict, const unsigned char *src, unsigned long len,
+      unsigned char *dst, unsigned long cap) {
+
+   return dict_decompress(dict, src, len, dst, cap);
+}
+
+void huff_stats_enable(int on) {
+   stats_enable(on);
+
+   return;
+}
+
+void huff_stats_print(FILE *file, int decompress) {
+   stats_print(file, "libhuff", decompress);
+
+   return;
+}
+
+const char *huff_error_string(int err) {
+   switch (err) {
+      case HUFF_OK:
+         return "no error";
+      case HUFF_ERR_READ:
+         return "failure to read the input";
+      case HUFF_ERR_WRITE:
+         return "failure to write the output";
+      case HUFF_ERR_CORRUPT:
+         return "the compressed data is corrupt or truncated";
+      case HUFF_ERR_MEMORY:
+         return "out of memory";
+      case HUFF_ERR_SPACE:
+         return "the output buffer is too small";
+      case HUFF_ERR_ARGUMENT:
+         return "invalid argument";
+      case HUFF_ERR_CHECKSUM:
+         return "a block's characters do not match its checksum";
+      case HUFF_NEED_INPUT:
+         return "the stream needs more input";
+      case HUFF_OUTPUT_FULL:
+         return "the output buffer is full";
+      default:
+         return "unknown error";
+   }
+}
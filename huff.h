@@ -0,0 +1,122 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      The library interface.  Buffers are compressed to and from the block
+ *      based stream format (see block_huff.h) entirely in memory, so the
+ *      output of huff_compress() is a valid .huff file and any stream file
+ *      can be handed to huff_decompress().  Every call returns a byte count
+ *      or one of the negative error codes below, nothing exits.
+ *
+ *      The context is owned by the caller and keeps the decode tables from
+ *      call to call.  Once it has been set up with huff_init() the calls do
+ *      not allocate (a decode table only grows when a block needs more
+ *      entries than any block before it, and the range call keeps a buffer
+ *      of the largest block it had to cut).  A context must not be shared
+ *      by two threads at once, give every thread its own.
+ *
+ *      A stream that arrives in pieces, from a socket on an event loop say,
+ *      is decoded with a huff_push decoder instead.  Every huff_push() call
+ *      takes whatever input there is, as little as a byte, and returns
+ *      HUFF_NEED_INPUT when it has used all of it or HUFF_OUTPUT_FULL when
+ *      the caller's buffer filled up first, and never waits.  Everything
+ *      the decoder is in the middle of is kept in the decoder, so a process
+ *      may have as many as it has connections.  The characters of a block
+ *      come out once the whole block is in, checked against its checksum.
+ *
+ *      Small messages are better coded with a dictionary, a table trained
+ *      once from similar messages (see dict_huff.h).  A loaded dictionary
+ *      is only read by the calls and may be shared by threads.
+ *
+ *      huff_stats_enable(1) starts the phase timers and counters of every
+ *      call (see stats_huff.h), huff_stats_print() writes them as one line
+ *      of JSON and they can be read directly from huff_stats.
+ *
+ ***************************/
+
+#ifndef HUFFMAN_LIB
+#define HUFFMAN_LIB
+
+#include "decode_huff.h"
+#include "dict_huff.h"
+#include "stats_huff.h"
+
+// error codes
+#define HUFF_OK             0
+#define HUFF_ERR_READ      -1
+#define HUFF_ERR_WRITE     -2
+#define HUFF_ERR_CORRUPT   -3
+#define HUFF_ERR_MEMORY    -4
+#define HUFF_ERR_SPACE     -5
+#define HUFF_ERR_ARGUMENT  -6
+#define HUFF_ERR_CHECKSUM  -7
+
+// where huff_push() stopped short of the end of the stream
+#define HUFF_NEED_INPUT     1
+#define HUFF_OUTPUT_FULL    2
+
+struct huff_ctx {
+   unsigned long block_size;     // characters per block when compressing
+   int streams;                  // 1, or 4 for the four stream payload
+   int split;                    // 0 for fixed blocks, up to MAX_SPLIT_LEVEL to cut them where the statistics change
+   int context;                  // nonzero to code with tables picked by the previous character
+   int checksum;                 // nonzero to store a CRC32C of every block's characters
+   int sample;                   // nonzero to store blocks a sample says are incompressible without counting them
+   struct decode_table table;    // reused by every block decoded
+   unsigned char *scratch;       // a block cut by huff_decompress_range()
+   unsigned long scratch_cap;
+};
+
+struct huff_push {
+   int state;                    // the part of the stream expected next
+   int ret;                      // the error the decoder stopped at for good
+   unsigned char head[16];       // the magic number and flags, a block prefix or the footer as far as it came
+   unsigned long have;           // bytes of the part being gathered so far
+   int flags;                    // the stream's flags
+   int type;                     // the block being gathered
+   unsigned long raw_len;
+   unsigned long size;
+   unsigned long long skip;      // bytes of the block index still to pass over
+   unsigned long long offset;    // where the next block starts in the stream
+   unsigned long long raw_offset; // and where its characters start in the original
+   unsigned long blocks;         // blocks met so far
+   unsigned long long end;       // where the end block starts
+   unsigned int index_crc;       // CRC32C of the index entries the blocks call for
+   unsigned int seen_crc;        // and of the entries that came
+   unsigned char *in;            // a block that came in pieces
+   unsigned long in_cap;
+   unsigned char *out;           // the characters of a block too large for the caller's buffer
+   unsigned long out_cap;
+   unsigned long out_pos;        // how many of them were handed out
+   unsigned long out_len;
+   struct decode_table table;    // reused by every block decoded
+};
+
+// function prototypes
+int  huff_init(struct huff_ctx *ctx);
+void huff_free(struct huff_ctx *ctx);
+unsigned long huff_compress_bound(const struct huff_ctx *ctx, unsigned long len);
+long huff_compress(struct huff_ctx *ctx, const unsigned char *src, unsigned long len, unsigned char *dst, unsigned long cap);
+long huff_decompressed_size(const unsigned char *src, unsigned long len);
+long huff_decompress(struct huff_ctx *ctx, const unsigned char *src, unsigned long len, unsigned char *dst, unsigned long cap);
+long huff_decompress_range(struct huff_ctx *ctx, const unsigned char *src, unsigned long len, unsigned long long start,
+      unsigned char *dst, unsigned long count);
+void huff_push_init(struct huff_push *push);
+int  huff_push(struct huff_push *push, const unsigned char *src, unsigned long len, unsigned long *used,
+      unsigned char *dst, unsigned long cap, unsigned long *written);
+void huff_push_free(struct huff_push *push);
+long huff_dict_train(const unsigned char *src, unsigned long len, unsigned char *dst, unsigned long cap);
+int  huff_dict_load(struct huff_dict *dict, const unsigned char *data, unsigned long len);
+void huff_dict_free(struct huff_dict *dict);
+unsigned long huff_dict_bound(unsigned long len);
+long huff_dict_compress(struct huff_dict *dict, const unsigned char *src, unsigned long len, unsigned char *dst, unsigned long cap);
+long huff_dict_id(const unsigned char *src, unsigned long len);
+long huff_dict_decompressed_size(const unsigned char *src, unsigned long len);
+long huff_dict_decompress(struct huff_dict *dict, const unsigned char *src, unsigned long len, unsigned char *dst, unsigned long cap);
+void huff_stats_enable(int on);
+void huff_stats_print(FILE *file, int decompress);
+const char *huff_error_string(int err);
+
+#endif //HUFFMAN_LIB
@@ -17,51 +17,189 @@
  *
  ***************************/
 
-#include <stdio.h>   // fopen(), fclose(), printf(), fgetc(), fprintf(), fwrite()
-#include <string.h>  // strlen(), strncpy(), strncat() 
-#include <stdlib.h>  // exit()
-
+#include <stdio.h>     // fopen(), fclose(), fflush(), fileno(), printf(), fprintf(), snprintf(), getline()
+#include <string.h>    // strlen(), strcpy(), strcat(), strcmp(), strdup()
+#include <stdlib.h>    // exit(), strtol(), atexit(), malloc(), realloc(), free()
+#include <unistd.h>    // STDIN_FILENO, STDOUT_FILENO, lseek(), close()
+#include <fcntl.h>     // open()
+#include <getopt.h>    // getopt_long()
+#include <dirent.h>    // scandir(), alphasort()
+#include <sys/stat.h>  // stat(), lstat()
+
+#include "huff.h"
 #include "tree_huff.h"
+#include "encode_huff.h"
+#include "block_huff.h"
+#include "archive_huff.h"
+#include "io_huff.h"
+#include "pool_huff.h"
 
 #define FILE_NAME_MAX_LEN 270
 #define MAX_FILE_NAME 256
 
+// the files going into an archive
+struct name_list {
+   char **names;
+   unsigned long count;
+   unsigned long cap;
+};
+
 // function prototypes
-void add_magic_num(FILE *file);
+void add_magic_num(FILE *file, int canonical);
 void add_bit_vector(FILE *file, unsigned char bit_vector[32]);
 int  add_size(FILE *file, int freq[MAX_CHARS]);
 void add_character_counts(FILE *file, int freq[MAX_CHARS], int num_bytes);
+void add_total(FILE *file, int freq[MAX_CHARS]);
+void add_code_lengths(FILE *file, int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS]);
+void stream_file(const char *name, unsigned long block_size, int threads, int streams, int split, int context, int checksum, int sample);
+void train_file(const char *dict_name, int num, char *names[], int threads);
+void dict_file(const char *name, const char *dict_name);
+void archive_files(const char *archive_name, int num, char *paths[], unsigned long block_size, int threads, int streams, int split, int context, int checksum, int sample);
+int  add_path(struct name_list *list, const char *path, int named);
+int  add_name(struct name_list *list, const char *name);
+int  parse_threads(const char *arg, int *threads);
+int  parse_number(const char *arg, long *num);
+void print_stats(void);
 
 int main(int argc, char *argv[]) {
 
    // variable declarations
-   FILE *file_in, *file_out;
-   int freq[MAX_CHARS] = {0}, c = 0, count = 0, num_bytes = 0, ret = 0;
-   unsigned char bit_vector[32] = {0x00}, packed = 0;
-   char output_file_name[MAX_FILE_NAME] = "", s[MAX_PATH] = "", temp[2*MAX_PATH] = "";
-   struct node *tree_head = NULL;
-   struct code code_values[MAX_CHARS] = {{-1, {0}, 0}};
+   FILE *file_out;
+   int freq[MAX_CHARS] = {0}, count = 0, num_bytes = 0, ret = 0, opt = 0, canonical = 0, stream = 0, streams = 1, threads = 1, split = 0, context = 0, checksum = 1, sample = 0;
+   unsigned long block_size = DEFAULT_BLOCK_SIZE;
+   long num = 0;
+   unsigned char bit_vector[32] = {0x00}, lengths[MAX_CHARS] = {0};
+   char output_file_name[MAX_FILE_NAME] = "";
+   struct huff_tree tree;
+   struct code code_values[MAX_CHARS] = {{-1, 0, 0}};
+   struct encode_table encode;
+   struct bit_writer bw;
+   struct input_file input;
+   struct output_file out;
+   const char *train_name = NULL, *dict_name = NULL, *archive_name = NULL;
+   const struct option long_options[] = {{"train", required_argument, NULL, 'R'}, {"stats", no_argument, NULL, 'S'},
+      {"no-checksum", no_argument, NULL, 'N'}, {"archive", required_argument, NULL, 'A'},
+      {"sample", no_argument, NULL, 'P'}, {NULL, 0, NULL, 0}};
+
+   // -c writes the canonical format with length limited codes, -s the block
+   // based stream format with -b KiB blocks, -4 splits the stream blocks
+   // into four interleaved streams, -x codes stream blocks with tables picked
+   // by the previous character, -a level cuts stream blocks short where the
+   // statistics change, -T threads share the counting and the blocks.
+   // --no-checksum leaves the CRC32C out of the stream blocks, --sample
+   // stores blocks a sample of them says are incompressible without
+   // counting the whole block.
+   // --archive compresses every file named, and every file in every
+   // directory named, into one archive (- reads the names from standard
+   // input, one a line).
+   // --train writes a dictionary trained on the samples that -D then
+   // codes small files with.  --stats writes the phase times and counters
+   // to the standard error as JSON when the program ends
+   while ((opt = getopt_long(argc, argv, "cs4xa:b:T:D:", long_options, NULL)) != -1) {
+      if (opt == 'c') {
+         canonical = 1;
+      } else if (opt == 's') {
+         stream = 1;
+      } else if (opt == '4') {
+         streams = 4;
+         stream = 1;
+      } else if (opt == 'x') {
+         context = 1;
+         stream = 1;
+      } else if (opt == 'a' && parse_number(optarg, &num) == 0) {
+         // a level or size out of range fails the checks further down
+         split = (num < 0 || num > MAX_SPLIT_LEVEL) ? -1 : (int)num;
+         stream = 1;
+      } else if (opt == 'b' && parse_number(optarg, &num) == 0) {
+         block_size = (num < 0 || num > MAX_BLOCK_SIZE / 1024) ? 0 : (unsigned long)num * 1024;
+         stream = 1;
+      } else if (opt == 'T' && parse_threads(optarg, &threads) == 0) {
+         // parse_threads() has checked and clamped the count
+      } else if (opt == 'R') {
+         train_name = optarg;
+      } else if (opt == 'D') {
+         dict_name = optarg;
+      } else if (opt == 'S') {
+         stats_enable(1);
+         atexit(print_stats);
+      } else if (opt == 'N') {
+         checksum = 0;
+         stream = 1;
+      } else if (opt == 'P') {
+         sample = 1;
+         stream = 1;
+      } else if (opt == 'A') {
+         archive_name = optarg;
+      } else {
+         printf("Format needs to be: ./huffman [-c] [-s] [-4] [-x] [-a level] [-b KiB] [-T threads] [-D dictionary] [--no-checksum] [--sample] [--stats] filename\n"
+               "                or: ./huffman --train dictionary sample...\n"
+               "                or: ./huffman --archive archive [-4] [-x] [-a level] [-b KiB] [-T threads] path...\n");
+         exit(1);
+      }
+   }
 
+   // the dictionary is trained on every file named
+   if (train_name != NULL) {
+      if (optind == argc) {
+         printf("Format needs to be: ./huffman [-c] [-s] [-4] [-x] [-a level] [-b KiB] [-T threads] [-D dictionary] [--no-checksum] [--sample] [--stats] filename\n"
+                  "                or: ./huffman --train dictionary sample...\n"
+                  "                or: ./huffman --archive archive [-4] [-x] [-a level] [-b KiB] [-T threads] path...\n");
+         exit(1);
+      }
+      train_file(train_name, argc - optind, argv + optind, threads);
+      return 0;
+   }
+
+   // the stream settings apply to every entry of an archive
+   if (archive_name != NULL && optind < argc) {
+      if (block_size < MIN_BLOCK_SIZE || block_size > MAX_BLOCK_SIZE) {
+         fprintf(stderr, "Block size must be between %d and %d KiB.\n", MIN_BLOCK_SIZE / 1024, MAX_BLOCK_SIZE / 1024);
+         exit(1);
+      }
+      if (split < 0 || split > MAX_SPLIT_LEVEL) {
+         fprintf(stderr, "Split level must be between 0 and %d.\n", MAX_SPLIT_LEVEL);
+         exit(1);
+      }
+      archive_files(archive_name, argc - optind, argv + optind, block_size, threads, streams, split, context, checksum, sample);
+      return 0;
+   }
 
    // check that the input file was specified
-   if (argc != 2) {
-      printf("Format needs to be: ./huffman filename\n");
+   if (optind != argc - 1 || archive_name != NULL) {
+      printf("Format needs to be: ./huffman [-c] [-s] [-4] [-x] [-a level] [-b KiB] [-T threads] [-D dictionary] [--no-checksum] [--sample] [--stats] filename\n"
+               "                or: ./huffman --train dictionary sample...\n"
+               "                or: ./huffman --archive archive [-4] [-x] [-a level] [-b KiB] [-T threads] path...\n");
       exit(1);
    }
 
-   // open the input file for reading
-   if ((file_in = fopen(argv[1], "r")) == NULL) {
+   // a message coded with the dictionary carries no table of its own
+   if (dict_name != NULL) {
+      dict_file(argv[optind], dict_name);
+      return 0;
+   }
+
+   // the stream format is written in a single pass, "-" reads standard input
+   if (stream || strcmp(argv[optind], "-") == 0) {
+      if (block_size < MIN_BLOCK_SIZE || block_size > MAX_BLOCK_SIZE) {
+         fprintf(stderr, "Block size must be between %d and %d KiB.\n", MIN_BLOCK_SIZE / 1024, MAX_BLOCK_SIZE / 1024);
+         exit(1);
+      }
+      if (split < 0 || split > MAX_SPLIT_LEVEL) {
+         fprintf(stderr, "Split level must be between 0 and %d.\n", MAX_SPLIT_LEVEL);
+         exit(1);
+      }
+      stream_file(argv[optind], block_size, threads, streams, split, context, checksum, sample);
+      return 0;
+   }
+
+   // map the input file, both passes then run over the same memory
+   if (map_input(argv[optind], &input) != 0) {
       printf("Failed to open the input file.\n");
       exit(1);
    }
 
    // getting the frequency of each character in the input file
-   while ((c = fgetc(file_in)) != EOF) {
-      freq[c]++;
-   }
-
-   // close the input file
-   fclose(file_in);
+   count_characters_threads(input.data, input.len, freq, threads);
 
    // create the bit vector based on which characters were in the file.
    for (count = 0; count < MAX_CHARS; count++) {
@@ -70,16 +208,12 @@ int main(int argc, char *argv[]) {
       }
    }
 
-   // check the output file name length
-   if ((strlen(argv[1])+strlen(".huff")) >= MAX_FILE_NAME) {
+   // create the output file name, the name with .huff attached must fit
+   if (snprintf(output_file_name, sizeof output_file_name, "%s.huff", argv[optind]) >= (int)sizeof output_file_name) {
       printf("Input file name too long.  Output file cannot be generated.\n");
       exit(1);
    }
 
-   // create the output file name
-   strncpy(output_file_name, argv[1], MAX_FILE_NAME);
-   strncat(output_file_name, ".huff", MAX_FILE_NAME);
-
    // open the output file
    if ((file_out = fopen(output_file_name, "w")) == NULL) {
       printf("Output file failed to open.\n");
@@ -87,92 +221,73 @@ int main(int argc, char *argv[]) {
    }
 
    // compress the files information and add the compressed info to the header
-   add_magic_num(file_out);
+   add_magic_num(file_out, canonical);
    add_bit_vector(file_out, bit_vector);
-   num_bytes = add_size(file_out, freq);
-   add_character_counts(file_out, freq, num_bytes);
-
-   // build the tree
-   tree_head = generate_tree(freq);
 
-   // generate the huffman codes
-   build_codes(tree_head, code_values, s, 0);
+   if (canonical) {
+      // the codes follow from the lengths alone so only those are stored
+      generate_code_lengths(freq, lengths, CANONICAL_MAX_LEN);
+      build_canonical_codes(freq, lengths, code_values);
+      STATS_CODES(freq, lengths);
+      add_total(file_out, freq);
+      add_code_lengths(file_out, freq, lengths);
+   } else {
+      num_bytes = add_size(file_out, freq);
+      add_character_counts(file_out, freq, num_bytes);
+
+      // build the tree and generate the huffman codes
+      count = generate_tree(&tree, freq);
+      STATS_BEGIN(PHASE_CODES);
+      build_codes(&tree, count, code_values, 0, 0);
+      STATS_END();
+      for (count = 0; count < MAX_CHARS; count++) {
+         lengths[count] = (unsigned char)code_values[count].len;
+      }
+      STATS_CODES(freq, lengths);
+   }
 
-   // open the input file for reading
-   if ((file_in = fopen(argv[1], "r")) == NULL) {
-      printf("Failed to open the input file.\n");
+   // go through the input file packing the data into the output file based
+   // on the Huffman codes, after the header the writer thread takes over
+   // the file while the characters are coded
+   build_encode_table(&encode, code_values);
+   if (fflush(file_out) != 0 || open_output(fileno(file_out), &out) != 0) {
+      printf("Failed to allocate the output buffer.\n");
       exit(1);
    }
+   init_bit_writer(&bw, &out);
 
-   // go through the input file packing the data into the output file based on the Huffman codes
-   while ((c = fgetc(file_in)) != EOF) {
-      strncat(temp, code_values[c].path, 2*MAX_PATH);
+   encode_symbols(&encode, input.data, input.len, &bw);
 
-      // not enough data yet
-      if (strlen(temp) < 8) {
-         continue;
-      }
-
-      // pack and write the characters to the output file
-      while (strlen(temp) > 8) {
-         for (count = 0; count < 8; count++) {
-            if (temp[count] == '0') {
-               packed <<= 1;
-            } else {
-               packed = (packed << 1) | 0x01;
-            }
-         }
-
-         fwrite(&packed, sizeof(unsigned char), 1, file_out);
-         packed = 0;
-         strcpy(temp, &temp[8]);
-      }
+   // write out the remaining data, the last byte is padded with zeros
+   if (finish_bit_writer(&bw) != 0 || close_output(&out) != 0) {
+      printf("Failed to write the output file.\n");
+      exit(1);
    }
 
-   // reset the packed data
-   packed = 0;
-
-   // pack the remaining ammount and output to the file
-   if (strlen(temp) > 0) {
-      // pack the remaining data
-      for (count = 0; count < strlen(temp); count++) {
-         if (temp[count] == '0') {
-            packed <<= 1;
-         } else {
-            packed = (packed << 1) | 0x01;
-         }
-      }
-
-      // pad the data to make a full char
-      for (count = strlen(temp); count < 8; count++) {
-         packed = (packed << 1) ;
-      }
+   STATS_ADD(STAT_RAW_BYTES, input.len);
+   STATS_ADD(STAT_PACKED_BYTES, lseek(fileno(file_out), 0, SEEK_CUR));
 
-      // write the data to the file
-      fwrite(&packed, sizeof(unsigned char), 1, file_out);
-   }
-
-   // close the input file
-   if ((ret = fclose(file_in)) != 0) {
-      printf("Failed to close the input file.");
-   }
+   // release the input file
+   unmap_input(&input);
 
    // close the output file
    if ((ret = fclose(file_out)) != 0) {
       printf("Failed to close the output file.");
    }
 
-   // free the nodes of the tree
-   free_tree(tree_head);
-
    return 0;
 }
 
-void add_magic_num(FILE *file) {
+void add_magic_num(FILE *file, int canonical) {
    // variable declarations
    unsigned char magic_num[4] = {0x4C,0x70,0xF0,0x7C};
    int i = 0, ret = 0;
 
+   // the canonical format is marked by the last magic number byte
+   if (canonical) {
+      magic_num[3] = 0x7D;
+   }
+
    for (i = 0; i < 4; i++) {
       // print the magic numbers to the output file
       if ((ret = fprintf(file, "%c", magic_num[i])) != 1) {
@@ -264,3 +379,342 @@ void add_character_counts(FILE *file, int freq[MAX_CHARS], int num_bytes) {
    return;
 }
 
+
+void add_total(FILE *file, int freq[MAX_CHARS]) {
+   // variable declarations
+   unsigned long long total = 0;
+   int i = 0, ret = 0;
+
+   for (i = 0; i < MAX_CHARS; i++) {
+      total += freq[i];
+   }
+
+   // 8 bytes, most significant byte first
+   for (i = 7; i >= 0; i--) {
+      if ((ret = fprintf(file, "%c", (unsigned char)(total >> (i * 8)))) != 1) {
+         printf("Failure to output the character total.\n");
+         exit(1);
+      }
+   }
+
+   return;
+}
+
+void add_code_lengths(FILE *file, int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS]) {
+   // variable declarations
+   unsigned char packed = 0;
+   int i = 0, ret = 0, half = 0;
+
+   // one 4 bit length per character in the bit vector, high nibble first
+   for (i = 0; i < MAX_CHARS; i++) {
+      if (freq[i] == 0) {
+         continue;
+      }
+
+      if (half == 0) {
+         packed = (unsigned char)(lengths[i] << 4);
+         half = 1;
+      } else {
+         packed |= lengths[i];
+         half = 0;
+         if ((ret = fprintf(file, "%c", packed)) != 1) {
+            printf("Failure to output the code lengths.\n");
+            exit(1);
+         }
+      }
+   }
+
+   // pad an odd count with an empty nibble
+   if (half == 1 && (ret = fprintf(file, "%c", packed)) != 1) {
+      printf("Failure to output the code lengths.\n");
+      exit(1);
+   }
+
+   return;
+}
+
+void stream_file(const char *name, unsigned long block_size, int threads, int streams, int split, int context, int checksum, int sample) {
+   // variable declarations
+   int fd_in = STDIN_FILENO, fd_out = STDOUT_FILENO;
+   char output_file_name[MAX_FILE_NAME] = "";
+   int ret = 0;
+
+   // standard input goes to standard output, a file to the file name with .huff attached
+   if (strcmp(name, "-") != 0) {
+      if (snprintf(output_file_name, sizeof output_file_name, "%s.huff", name) >= (int)sizeof output_file_name) {
+         fprintf(stderr, "Input file name too long.  Output file cannot be generated.\n");
+         exit(1);
+      }
+
+      if ((fd_in = open(name, O_RDONLY)) == -1) {
+         fprintf(stderr, "Failed to open the input file.\n");
+         exit(1);
+      }
+      if ((fd_out = open(output_file_name, O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1) {
+         fprintf(stderr, "Output file failed to open.\n");
+         exit(1);
+      }
+   }
+
+   // the reader and writer threads work on the descriptors themselves
+   if ((ret = compress_stream(fd_in, fd_out, block_size, threads, streams, split, context, checksum, sample)) != HUFF_OK) {
+      fprintf(stderr, "Compression failed: %s.\n", huff_error_string(ret));
+      exit(1);
+   }
+
+   // close the files
+   if ((ret = close(fd_in)) != 0) {
+      fprintf(stderr, "Failed to close the input file.\n");
+   }
+   if ((ret = close(fd_out)) != 0) {
+      fprintf(stderr, "Failed to close the output file.\n");
+      exit(1);
+   }
+
+   return;
+}
+
+void train_file(const char *dict_name, int num, char *names[], int threads) {
+   // variable declarations
+   FILE *file_out;
+   int freq[MAX_CHARS] = {0}, i = 0;
+   unsigned char dict[DICT_SIZE];
+   struct input_file input;
+
+   // the samples are counted together
+   for (i = 0; i < num; i++) {
+      if (map_input(names[i], &input) != 0) {
+         fprintf(stderr, "Failed to open the sample file %s.\n", names[i]);
+         exit(1);
+      }
+      count_characters_threads(input.data, input.len, freq, threads);
+      unmap_input(&input);
+   }
+
+   train_dict(freq, dict);
+
+   if ((file_out = fopen(dict_name, "w")) == NULL) {
+      fprintf(stderr, "Dictionary file failed to open.\n");
+      exit(1);
+   }
+   if (fwrite(dict, sizeof(unsigned char), DICT_SIZE, file_out) != DICT_SIZE || fclose(file_out) != 0) {
+      fprintf(stderr, "Failed to write the dictionary.\n");
+      exit(1);
+   }
+
+   return;
+}
+
+void dict_file(const char *name, const char *dict_name) {
+   // variable declarations
+   FILE *file_out = stdout;
+   char output_file_name[MAX_FILE_NAME] = "";
+   unsigned char *out = NULL;
+   long len = 0;
+   struct input_file input;
+   struct huff_dict dict;
+
+   if (map_input(dict_name, &input) != 0) {
+      fprintf(stderr, "Failed to open the dictionary.\n");
+      exit(1);
+   }
+   if (load_dict(input.data, input.len, &dict) != HUFF_OK) {
+      fprintf(stderr, "%s is not a dictionary.\n", dict_name);
+      exit(1);
+   }
+   unmap_input(&input);
+
+   // standard input goes to standard output, a file to the file name with .huff attached
+   if (strcmp(name, "-") == 0) {
+      if (map_input_fd(STDIN_FILENO, &input) != 0) {
+         fprintf(stderr, "Failed to read the standard input.\n");
+         exit(1);
+      }
+   } else {
+      if (snprintf(output_file_name, sizeof output_file_name, "%s.huff", name) >= (int)sizeof output_file_name) {
+         fprintf(stderr, "Input file name too long.  Output file cannot be generated.\n");
+         exit(1);
+      }
+
+      if (map_input(name, &input) != 0) {
+         fprintf(stderr, "Failed to open the input file.\n");
+         exit(1);
+      }
+      if ((file_out = fopen(output_file_name, "w")) == NULL) {
+         fprintf(stderr, "Output file failed to open.\n");
+         exit(1);
+      }
+   }
+
+   if ((out = (unsigned char *)malloc(DICT_BOUND(input.len))) == NULL) {
+      fprintf(stderr, "Failure to allocate the output buffer.\n");
+      exit(1);
+   }
+   if ((len = dict_compress(&dict, input.data, input.len, out, DICT_BOUND(input.len))) < 0) {
+      fprintf(stderr, "Compression failed: %s.\n", huff_error_string(len));
+      exit(1);
+   }
+   if (fwrite(out, sizeof(unsigned char), len, file_out) != (unsigned long)len || fclose(file_out) != 0) {
+      fprintf(stderr, "Failed to write the output file.\n");
+      exit(1);
+   }
+
+   free(out);
+   unmap_input(&input);
+   free_dict(&dict);
+
+   return;
+}
+
+void archive_files(const char *archive_name, int num, char *paths[], unsigned long block_size, int threads, int streams, int split, int context, int checksum, int sample) {
+   // variable declarations
+   FILE *file_out = stdout;
+   struct name_list list = {NULL, 0, 0};
+   char *line = NULL;
+   size_t line_cap = 0;
+   long len = 0;
+   unsigned long failed = 0, i = 0;
+   int ret = 0, n = 0;
+
+   // the names are all collected first, directories in name order
+   for (n = 0; n < num; n++) {
+      if (strcmp(paths[n], "-") != 0) {
+         ret = add_path(&list, paths[n], 1);
+      } else {
+         while (ret == 0 && (len = getline(&line, &line_cap, stdin)) > 0) {
+            if (line[len - 1] == '\n') {
+               line[--len] = '\0';
+            }
+            ret = (len > 0) ? add_path(&list, line, 1) : 0;
+         }
+      }
+      if (ret != 0) {
+         fprintf(stderr, "Failed to read %s.\n", (strcmp(paths[n], "-") == 0) ? line : paths[n]);
+         exit(1);
+      }
+   }
+   free(line);
+
+   // "-" writes the archive to standard output
+   if (strcmp(archive_name, "-") != 0 && (file_out = fopen(archive_name, "w")) == NULL) {
+      fprintf(stderr, "Archive file failed to open.\n");
+      exit(1);
+   }
+
+   if ((ret = compress_archive(file_out, list.names, list.count, block_size, threads, streams, split, context, checksum, sample, &failed)) != HUFF_OK) {
+      if (ret == HUFF_ERR_READ || ret == HUFF_ERR_ARGUMENT) {
+         fprintf(stderr, "Failed to %s %s.\n", (ret == HUFF_ERR_READ) ? "read" : "store the name of", list.names[failed]);
+      } else {
+         fprintf(stderr, "Compression failed: %s.\n", huff_error_string(ret));
+      }
+      exit(1);
+   }
+   if (fclose(file_out) != 0) {
+      fprintf(stderr, "Failed to close the archive file.\n");
+      exit(1);
+   }
+
+   for (i = 0; i < list.count; i++) {
+      free(list.names[i]);
+   }
+   free(list.names);
+
+   return;
+}
+
+int add_path(struct name_list *list, const char *path, int named) {
+   // variable declarations
+   struct stat info;
+   struct dirent **children = NULL;
+   char *child = NULL;
+   int num = 0, i = 0, ret = 0;
+
+   // a path that was named is followed if it is a link, links found in a
+   // directory are left out like everything else that is not a regular
+   // file or a directory
+   if ((named ? stat(path, &info) : lstat(path, &info)) != 0) {
+      return -1;
+   }
+   if (S_ISREG(info.st_mode)) {
+      return add_name(list, path);
+   }
+   if (!S_ISDIR(info.st_mode)) {
+      return 0;
+   }
+
+   if ((num = scandir(path, &children, NULL, alphasort)) < 0) {
+      return -1;
+   }
+   for (i = 0; i < num; i++) {
+      if (ret == 0 && strcmp(children[i]->d_name, ".") != 0 && strcmp(children[i]->d_name, "..") != 0) {
+         if ((child = (char *)malloc(strlen(path) + strlen(children[i]->d_name) + 2)) == NULL) {
+            ret = -1;
+         } else {
+            strcpy(child, path);
+            if (child[strlen(child) - 1] != '/') {
+               strcat(child, "/");
+            }
+            strcat(child, children[i]->d_name);
+            ret = add_path(list, child, 0);
+            free(child);
+         }
+      }
+      free(children[i]);
+   }
+   free(children);
+
+   return ret;
+}
+
+int add_name(struct name_list *list, const char *name) {
+   // variable declarations
+   char **grown = NULL;
+
+   if (list->count == list->cap) {
+      list->cap = (list->cap == 0) ? 1024 : list->cap * 2;
+      if ((grown = (char **)realloc(list->names, list->cap * sizeof(char *))) == NULL) {
+         return -1;
+      }
+      list->names = grown;
+   }
+   if ((list->names[list->count] = strdup(name)) == NULL) {
+      return -1;
+   }
+   list->count++;
+
+   return 0;
+}
+
+int parse_threads(const char *arg, int *threads) {
+   // variable declarations
+   char *end = NULL;
+   long num = 0;
+
+   // a positive count, more than the pool can run only buys more memory
+   num = strtol(arg, &end, 10);
+   if (end == arg || *end != '\0' || num <= 0) {
+      return -1;
+   }
+   *threads = (num > MAX_THREADS) ? MAX_THREADS : (int)num;
+
+   return 0;
+}
+
+int parse_number(const char *arg, long *num) {
+   // variable declarations
+   char *end = NULL;
+
+   // the whole argument must be the number
+   *num = strtol(arg, &end, 10);
+   if (end == arg || *end != '\0') {
+      return -1;
+   }
+
+   return 0;
+}
+
+void print_stats(void) {
+   stats_print(stderr, "huffman", 0);
+
+   return;
+}
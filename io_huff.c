@@ -0,0 +1,487 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      This file is the implementation code for the whole file input and the
+ *      buffered output.  Regular files are mapped read only and the kernel
+ *      is told they will be read front to back.  Anything that cannot be
+ *      mapped (pipes, terminals, some special files) is read in INPUT_CHUNK
+ *      pieces into a growing buffer.  Output of a known size can go into a
+ *      shared mapping of the output file, anything else is gathered a
+ *      ring buffer at a time and handed to the writer thread.
+ *
+ *      The caller and the I/O thread of a ring only ever touch different
+ *      buffers, the lock guards the two counts that say whose each one is.
+ *      The time the caller waits on the ring is charged to reading or
+ *      writing, the I/O thread only counts its calls and bytes, so the
+ *      phase times show what the overlap did not hide.
+ *
+ ***************************/
+
+#include <stdlib.h>    // malloc(), realloc(), free()
+#include <string.h>    // memcpy()
+#include <errno.h>     // errno, EINTR
+#include <fcntl.h>     // open()
+#include <unistd.h>    // read(), write(), close(), lseek(), ftruncate()
+#include <pthread.h>   // pthread_create(), pthread_join(), pthread_cancel(), pthread_setcancelstate()
+#include <sys/mman.h>  // mmap(), munmap(), madvise()
+#include <sys/stat.h>  // fstat()
+
+#include "io_huff.h"
+#include "stats_huff.h"
+
+// function prototypes
+static int  init_ring(int fd, struct io_ring *ring, void *(*func)(void *arg));
+static void free_ring(struct io_ring *ring);
+static void *reader_thread(void *arg);
+static void *writer_thread(void *arg);
+
+int map_input(const char *name, struct input_file *input) {
+   // variable declarations
+   int fd = 0, ret = 0;
+
+   if ((fd = open(name, O_RDONLY)) == -1) {
+      return -1;
+   }
+
+   ret = map_input_fd(fd, input);
+   close(fd);
+
+   return ret;
+}
+
+int map_input_fd(int fd, struct input_file *input) {
+   // variable declarations
+   unsigned char *grown = NULL;
+   unsigned long cap = 0;
+   long ret = 0;
+
+   if (map_file(fd, input) == 0) {
+      return 0;
+   }
+
+   // otherwise read everything in large pieces
+   for (;;) {
+      if (cap - input->len < INPUT_CHUNK) {
+         cap += (cap < INPUT_CHUNK) ? INPUT_CHUNK : cap;
+         if ((grown = (unsigned char *)realloc(input->data, cap)) == NULL) {
+            unmap_input(input);
+            return -1;
+         }
+         input->data = grown;
+      }
+      if ((ret = stats_read(fd, input->data + input->len, cap - input->len)) < 0) {
+         unmap_input(input);
+         return -1;
+      }
+      if (ret == 0) {
+         break;
+      }
+      input->len += ret;
+   }
+
+   return 0;
+}
+
+int map_file(int fd, struct input_file *input) {
+   // variable declarations
+   struct stat info;
+   off_t start = 0;
+   void *map = NULL;
+
+   input->data = NULL;
+   input->len = 0;
+   input->mapped = 0;
+   input->map = NULL;
+   input->map_len = 0;
+
+   // only a regular file with something left in it can be mapped, the
+   // data starts wherever the descriptor is and the mapping outlives it
+   start = lseek(fd, 0, SEEK_CUR);
+   if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || start < 0 || info.st_size <= start) {
+      return -1;
+   }
+   if ((map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+      return -1;
+   }
+
+   madvise(map, info.st_size, MADV_SEQUENTIAL);
+   input->map = map;
+   input->map_len = info.st_size;
+   input->data = (unsigned char *)map + start;
+   input->len = info.st_size - start;
+   input->mapped = 1;
+   STATS_ADD(STAT_MAPPED_BYTES, input->len);
+
+   return 0;
+}
+
+void unmap_input(struct input_file *input) {
+
+   if (input->mapped) {
+      munmap(input->map, input->map_len);
+   } else {
+      free(input->data);
+   }
+   input->data = NULL;
+   input->len = 0;
+   input->mapped = 0;
+   input->map = NULL;
+   input->map_len = 0;
+
+   return;
+}
+
+int open_output(int fd, struct output_file *out) {
+
+   out->fd = fd;
+   out->pos = 0;
+   out->cap = RING_CHUNK;
+   out->mapped = 0;
+   out->error = 0;
+
+   // the output is filled straight into the ring's buffers
+   if (start_writer(fd, &out->ring) != 0) {
+      return -1;
+   }
+   out->buf = out->ring.bufs[0];
+
+   return 0;
+}
+
+int map_output(int fd, unsigned long len, struct output_file *out) {
+   // variable declarations
+   struct stat info;
+   void *map = NULL;
+
+   // only a regular file can be sized and mapped
+   if (len == 0 || fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || ftruncate(fd, len) != 0) {
+      return -1;
+   }
+   if ((map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+      return -1;
+   }
+
+   out->fd = fd;
+   out->buf = (unsigned char *)map;
+   out->pos = 0;
+   out->cap = len;
+   out->mapped = 1;
+   out->error = 0;
+   STATS_ADD(STAT_MAPPED_BYTES, len);
+
+   return 0;
+}
+
+int flush_output(struct output_file *out) {
+
+   // a mapping is written back by the kernel, a buffer by the writer thread
+   if (out->mapped) {
+      return out->error ? -1 : 0;
+   }
+
+   if (out->pos > 0) {
+      out->buf = ring_swap(&out->ring, out->pos);
+      out->pos = 0;
+   }
+
+   return out->error ? -1 : 0;
+}
+
+int close_output(struct output_file *out) {
+   // variable declarations
+   int ret = 0;
+
+   ret = flush_output(out);
+
+   if (out->mapped) {
+      // whatever was not written is cut off again
+      if (munmap(out->buf, out->cap) != 0 || (out->pos < out->cap && ftruncate(out->fd, out->pos) != 0)) {
+         ret = -1;
+      }
+   } else if (stop_writer(&out->ring) != 0) {
+      out->error = 1;
+      ret = -1;
+   }
+   out->buf = NULL;
+
+   return ret;
+}
+
+int start_reader(int fd, struct io_ring *ring) {
+   return init_ring(fd, ring, reader_thread);
+}
+
+long ring_read(struct io_ring *ring, unsigned char *buf, unsigned long len) {
+   // variable declarations
+   unsigned long done = 0, num = 0, k = 0;
+   int error = 0;
+
+   // like fread(), only short at the end of the input
+   pthread_mutex_lock(&ring->lock);
+   while (done < len) {
+      if (ring->emptied == ring->filled) {
+         if (ring->eof || ring->error) {
+            break;
+         }
+         STATS_BEGIN(PHASE_READ);
+         pthread_cond_wait(&ring->changed, &ring->lock);
+         STATS_END();
+         continue;
+      }
+      pthread_mutex_unlock(&ring->lock);
+
+      // the buffer at the front is the caller's until it is handed back
+      k = ring->emptied % RING_BUFFERS;
+      num = (ring->lens[k] - ring->pos < len - done) ? ring->lens[k] - ring->pos : len - done;
+      memcpy(buf + done, ring->bufs[k] + ring->pos, num);
+      ring->pos += num;
+      done += num;
+
+      pthread_mutex_lock(&ring->lock);
+      if (ring->pos == ring->lens[k]) {
+         ring->pos = 0;
+         ring->emptied++;
+         pthread_cond_broadcast(&ring->changed);
+      }
+   }
+   error = ring->error && done < len;
+   pthread_mutex_unlock(&ring->lock);
+
+   return error ? -1 : (long)done;
+}
+
+void stop_reader(struct io_ring *ring) {
+
+   // a reader waiting on a pipe that has nothing more to say is woken by
+   // cancelling it, it can only be cancelled inside read()
+   pthread_mutex_lock(&ring->lock);
+   ring->stop = 1;
+   pthread_cond_broadcast(&ring->changed);
+   pthread_mutex_unlock(&ring->lock);
+   pthread_cancel(ring->thread);
+   pthread_join(ring->thread, NULL);
+
+   free_ring(ring);
+
+   return;
+}
+
+int start_writer(int fd, struct io_ring *ring) {
+   return init_ring(fd, ring, writer_thread);
+}
+
+unsigned char *ring_swap(struct io_ring *ring, unsigned long len) {
+   // variable declarations
+   unsigned char *buf = NULL;
+
+   // hand over the caller's buffer and wait for the next one to be free
+   pthread_mutex_lock(&ring->lock);
+   ring->lens[ring->filled % RING_BUFFERS] = len;
+   ring->filled++;
+   pthread_cond_broadcast(&ring->changed);
+   while (ring->filled - ring->emptied == RING_BUFFERS) {
+      STATS_BEGIN(PHASE_WRITE);
+      pthread_cond_wait(&ring->changed, &ring->lock);
+      STATS_END();
+   }
+   buf = ring->bufs[ring->filled % RING_BUFFERS];
+   pthread_mutex_unlock(&ring->lock);
+
+   return buf;
+}
+
+int ring_write(struct io_ring *ring, const unsigned char *buf, unsigned long len) {
+   // variable declarations
+   unsigned char *dst = ring->bufs[ring->filled % RING_BUFFERS];
+   unsigned long done = 0, num = 0;
+   int error = 0;
+
+   while (done < len) {
+      num = (RING_CHUNK - ring->pos < len - done) ? RING_CHUNK - ring->pos : len - done;
+      memcpy(dst + ring->pos, buf + done, num);
+      ring->pos += num;
+      done += num;
+      if (ring->pos == RING_CHUNK) {
+         dst = ring_swap(ring, RING_CHUNK);
+         ring->pos = 0;
+      }
+   }
+
+   // a failed write shows up on the next call, or at the end
+   pthread_mutex_lock(&ring->lock);
+   error = ring->error;
+   pthread_mutex_unlock(&ring->lock);
+
+   return error ? -1 : 0;
+}
+
+int stop_writer(struct io_ring *ring) {
+   // variable declarations
+   int error = 0;
+
+   if (ring->pos > 0) {
+      ring_swap(ring, ring->pos);
+      ring->pos = 0;
+   }
+
+   // the writer thread empties the ring before it stops
+   pthread_mutex_lock(&ring->lock);
+   ring->stop = 1;
+   pthread_cond_broadcast(&ring->changed);
+   pthread_mutex_unlock(&ring->lock);
+   pthread_join(ring->thread, NULL);
+
+   error = ring->error;
+   free_ring(ring);
+
+   return error ? -1 : 0;
+}
+
+static int init_ring(int fd, struct io_ring *ring, void *(*func)(void *arg)) {
+   // variable declarations
+   int i = 0;
+
+   ring->fd = fd;
+   ring->filled = 0;
+   ring->emptied = 0;
+   ring->pos = 0;
+   ring->eof = 0;
+   ring->error = 0;
+   ring->stop = 0;
+
+   for (i = 0; i < RING_BUFFERS; i++) {
+      ring->lens[i] = 0;
+      if ((ring->bufs[i] = (unsigned char *)malloc(RING_CHUNK)) == NULL) {
+         while (i-- > 0) {
+            free(ring->bufs[i]);
+         }
+         return -1;
+      }
+   }
+
+   pthread_mutex_init(&ring->lock, NULL);
+   pthread_cond_init(&ring->changed, NULL);
+   if (pthread_create(&ring->thread, NULL, func, ring) != 0) {
+      free_ring(ring);
+      return -1;
+   }
+
+   return 0;
+}
+
+static void free_ring(struct io_ring *ring) {
+   // variable declarations
+   int i = 0;
+
+   for (i = 0; i < RING_BUFFERS; i++) {
+      free(ring->bufs[i]);
+      ring->bufs[i] = NULL;
+   }
+   pthread_mutex_destroy(&ring->lock);
+   pthread_cond_destroy(&ring->changed);
+
+   return;
+}
+
+static void *reader_thread(void *arg) {
+   // variable declarations
+   struct io_ring *ring = (struct io_ring *)arg;
+   unsigned char *buf = NULL;
+   unsigned long len = 0;
+   long ret = 0;
+
+   pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+   pthread_mutex_lock(&ring->lock);
+   while (!ring->stop && !ring->eof && !ring->error) {
+      // wait for the caller to hand a buffer back
+      if (ring->filled - ring->emptied == RING_BUFFERS) {
+         pthread_cond_wait(&ring->changed, &ring->lock);
+         continue;
+      }
+      buf = ring->bufs[ring->filled % RING_BUFFERS];
+      pthread_mutex_unlock(&ring->lock);
+
+      // a buffer is filled before it is handed over, a pipe gives at most
+      // a pipe buffer per read and the ring would hold little ahead
+      pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+      for (len = 0; len < RING_CHUNK; len += ret) {
+         if ((ret = read(ring->fd, buf + len, RING_CHUNK - len)) < 0 && errno == EINTR) {
+            ret = 0;
+            continue;
+         }
+         STATS_ADD(STAT_READ_CALLS, 1);
+         if (ret <= 0) {
+            break;
+         }
+         STATS_ADD(STAT_READ_BYTES, ret);
+      }
+      pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+      pthread_mutex_lock(&ring->lock);
+      if (len > 0) {
+         ring->lens[ring->filled % RING_BUFFERS] = len;
+         ring->filled++;
+      }
+      if (ret < 0) {
+         ring->error = 1;
+      } else if (ret == 0) {
+         ring->eof = 1;
+      }
+      pthread_cond_broadcast(&ring->changed);
+   }
+   pthread_mutex_unlock(&ring->lock);
+
+   return NULL;
+}
+
+static void *writer_thread(void *arg) {
+   // variable declarations
+   struct io_ring *ring = (struct io_ring *)arg;
+   unsigned char *buf = NULL;
+   unsigned long len = 0, done = 0;
+   long ret = 0;
+   int error = 0;
+
+   pthread_mutex_lock(&ring->lock);
+   for (;;) {
+      // wait for a full buffer, or to be told there are no more
+      if (ring->emptied == ring->filled) {
+         if (ring->stop) {
+            break;
+         }
+         pthread_cond_wait(&ring->changed, &ring->lock);
+         continue;
+      }
+      buf = ring->bufs[ring->emptied % RING_BUFFERS];
+      len = ring->lens[ring->emptied % RING_BUFFERS];
+      error = ring->error;
+      pthread_mutex_unlock(&ring->lock);
+
+      // after a failure the buffers are only handed back, so the caller
+      // never waits forever
+      for (done = 0; done < len && !error; ) {
+         if ((ret = write(ring->fd, buf + done, len - done)) < 0 && errno == EINTR) {
+            continue;
+         }
+         STATS_ADD(STAT_WRITE_CALLS, 1);
+         STATS_ADD(STAT_WRITE_BYTES, (ret > 0) ? ret : 0);
+         if (ret <= 0) {
+            error = 1;
+         } else {
+            done += ret;
+         }
+      }
+
+      pthread_mutex_lock(&ring->lock);
+      ring->error = error;
+      ring->emptied++;
+      pthread_cond_broadcast(&ring->changed);
+   }
+   pthread_mutex_unlock(&ring->lock);
+
+   return NULL;
+}
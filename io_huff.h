@@ -0,0 +1,91 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      Whole file input and buffered output.  A file is memory mapped when
+ *      the system allows it, otherwise it is pulled into memory with large
+ *      reads.  Either way the callers see one flat buffer.  Output is
+ *      collected in a large buffer that goes out in big write() calls, or,
+ *      when its size is known up front, is placed straight into a mapping
+ *      of the output file.
+ *
+ *      Reads and writes that cannot be mapped go through a ring of buffers
+ *      with a thread of their own at the far end: a reader thread keeps
+ *      the ring full ahead of the caller, a writer thread empties it
+ *      behind.  The coding and the I/O then overlap and a run takes about
+ *      as long as the slower of the two instead of their sum.
+ *
+ ***************************/
+
+#ifndef HUFFMAN_IO
+#define HUFFMAN_IO
+
+#include <pthread.h>
+
+#define INPUT_CHUNK  (1 << 22)
+#define OUTPUT_CHUNK (1 << 20)
+#define RING_CHUNK   (1 << 20)   // bytes per buffer of a ring, at least OUTPUT_CHUNK
+#define RING_BUFFERS 4           // buffers in flight between the caller and the I/O thread
+
+struct io_ring {
+   int fd;
+   pthread_t thread;
+   pthread_mutex_t lock;
+   pthread_cond_t changed;       // signaled whenever a buffer changes hands
+   unsigned char *bufs[RING_BUFFERS];
+   unsigned long lens[RING_BUFFERS];
+   unsigned long filled;         // buffers filled, by the reader thread or the caller
+   unsigned long emptied;        // buffers emptied, by the caller or the writer thread
+   unsigned long pos;            // how far the caller is into its buffer
+   int eof;
+   int error;
+   int stop;
+};
+
+struct input_file {
+   unsigned char *data;
+   unsigned long len;
+   int mapped;                   // nonzero when data is a mapping rather than a malloc
+   void *map;                    // the whole mapping, data may start part way in
+   unsigned long map_len;
+};
+
+struct output_file {
+   int fd;
+   unsigned char *buf;           // the write buffer, or the mapped file
+   unsigned long pos;
+   unsigned long cap;
+   int mapped;
+   int error;
+   struct io_ring ring;          // the writer thread when not mapped
+};
+
+// function prototypes
+int  map_input(const char *name, struct input_file *input);
+int  map_input_fd(int fd, struct input_file *input);
+int  map_file(int fd, struct input_file *input);
+void unmap_input(struct input_file *input);
+int  open_output(int fd, struct output_file *out);
+int  map_output(int fd, unsigned long len, struct output_file *out);
+int  flush_output(struct output_file *out);
+int  close_output(struct output_file *out);
+int  start_reader(int fd, struct io_ring *ring);
+long ring_read(struct io_ring *ring, unsigned char *buf, unsigned long len);
+void stop_reader(struct io_ring *ring);
+int  start_writer(int fd, struct io_ring *ring);
+unsigned char *ring_swap(struct io_ring *ring, unsigned long len);
+int  ring_write(struct io_ring *ring, const unsigned char *buf, unsigned long len);
+int  stop_writer(struct io_ring *ring);
+
+// room for n more bytes (at most OUTPUT_CHUNK), the caller fills it and
+// then moves pos past what it wrote
+static inline unsigned char *output_space(struct output_file *out, unsigned long n) {
+   if (!out->mapped && out->cap - out->pos < n) {
+      flush_output(out);
+   }
+   return out->buf + out->pos;
+}
+
+#endif //HUFFMAN_IO
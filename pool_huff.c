@@ -0,0 +1,156 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      This file is the implementation code for the worker thread pool.  A
+ *      NULL pool is valid everywhere and simply runs each job right away on
+ *      the calling thread, so single threaded callers share the same code.
+ *
+ ***************************/
+
+#include <stdlib.h>  // malloc(), free()
+
+#include "pool_huff.h"
+
+// function prototypes
+static void *run_worker(void *arg);
+
+struct pool *create_pool(int num_threads) {
+   // variable declarations
+   struct pool *pool = NULL;
+   int i = 0;
+
+   if (num_threads > MAX_THREADS) {
+      num_threads = MAX_THREADS;
+   }
+
+   if ((pool = (struct pool *)malloc(sizeof(struct pool))) == NULL) {
+      return NULL;
+   }
+
+   pthread_mutex_init(&pool->lock, NULL);
+   pthread_cond_init(&pool->work, NULL);
+   pthread_cond_init(&pool->finished, NULL);
+   pool->head = NULL;
+   pool->tail = NULL;
+   pool->stop = 0;
+   pool->num_threads = 0;
+
+   for (i = 0; i < num_threads; i++) {
+      if (pthread_create(&pool->threads[i], NULL, run_worker, pool) != 0) {
+         break;
+      }
+      pool->num_threads++;
+   }
+
+   // no workers at all is no pool at all
+   if (pool->num_threads == 0) {
+      destroy_pool(pool);
+      return NULL;
+   }
+
+   return pool;
+}
+
+void submit_job(struct pool *pool, struct job *job, void (*func)(void *arg), void *arg) {
+
+   job->func = func;
+   job->arg = arg;
+   job->done = 0;
+   job->next = NULL;
+
+   // without a pool the job runs right here
+   if (pool == NULL) {
+      func(arg);
+      job->done = 1;
+      return;
+   }
+
+   pthread_mutex_lock(&pool->lock);
+   if (pool->tail == NULL) {
+      pool->head = job;
+   } else {
+      pool->tail->next = job;
+   }
+   pool->tail = job;
+   pthread_cond_signal(&pool->work);
+   pthread_mutex_unlock(&pool->lock);
+
+   return;
+}
+
+void wait_job(struct pool *pool, struct job *job) {
+
+   if (pool == NULL) {
+      return;
+   }
+
+   pthread_mutex_lock(&pool->lock);
+   while (!job->done) {
+      pthread_cond_wait(&pool->finished, &pool->lock);
+   }
+   pthread_mutex_unlock(&pool->lock);
+
+   return;
+}
+
+void destroy_pool(struct pool *pool) {
+   // variable declarations
+   int i = 0;
+
+   if (pool == NULL) {
+      return;
+   }
+
+   // the workers finish the queued jobs before they see the stop
+   pthread_mutex_lock(&pool->lock);
+   pool->stop = 1;
+   pthread_cond_broadcast(&pool->work);
+   pthread_mutex_unlock(&pool->lock);
+
+   for (i = 0; i < pool->num_threads; i++) {
+      pthread_join(pool->threads[i], NULL);
+   }
+
+   pthread_mutex_destroy(&pool->lock);
+   pthread_cond_destroy(&pool->work);
+   pthread_cond_destroy(&pool->finished);
+   free(pool);
+
+   return;
+}
+
+static void *run_worker(void *arg) {
+   // variable declarations
+   struct pool *pool = (struct pool *)arg;
+   struct job *job = NULL;
+
+   pthread_mutex_lock(&pool->lock);
+   for (;;) {
+      while (pool->head == NULL && !pool->stop) {
+         pthread_cond_wait(&pool->work, &pool->lock);
+      }
+      if (pool->head == NULL) {
+         break;
+      }
+
+      // take the oldest job and run it without holding the lock
+      job = pool->head;
+      pool->head = job->next;
+      if (pool->head == NULL) {
+         pool->tail = NULL;
+      }
+      pthread_mutex_unlock(&pool->lock);
+
+      job->func(job->arg);
+
+      pthread_mutex_lock(&pool->lock);
+      job->done = 1;
+      pthread_cond_broadcast(&pool->finished);
+   }
+   pthread_mutex_unlock(&pool->lock);
+
+   return NULL;
+}
@@ -0,0 +1,44 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      A fixed size pool of worker threads.  Jobs are owned by the caller,
+ *      run in the order they were submitted and are waited on one at a
+ *      time, which is all the in order block writers need.
+ *
+ ***************************/
+
+#ifndef HUFFMAN_POOL
+#define HUFFMAN_POOL
+
+#include <pthread.h>
+
+#define MAX_THREADS 256
+
+struct job {
+   void (*func)(void *arg);
+   void *arg;
+   int done;
+   struct job *next;
+};
+
+struct pool {
+   pthread_t threads[MAX_THREADS];
+   int num_threads;
+   pthread_mutex_t lock;
+   pthread_cond_t work;          // signaled when a job is queued or the pool stops
+   pthread_cond_t finished;      // signaled when a job is done
+   struct job *head;
+   struct job *tail;
+   int stop;
+};
+
+// function prototypes
+struct pool *create_pool(int num_threads);
+void submit_job(struct pool *pool, struct job *job, void (*func)(void *arg), void *arg);
+void wait_job(struct pool *pool, struct job *job);
+void destroy_pool(struct pool *pool);
+
+#endif //HUFFMAN_POOL
@@ -0,0 +1,152 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      This file is the implementation code for the phase timers and
+ *      counters (see stats_huff.h).  Every thread keeps a small stack of
+ *      the phases it is in, the time since the last change is charged to
+ *      the phase on top.  The totals are shared and added to atomically.
+ *
+ ***************************/
+
+#include <string.h>  // memset()
+#include <math.h>    // log2()
+#include <time.h>    // clock_gettime()
+
+#include "stats_huff.h"
+
+#define MAX_PHASE_DEPTH 8
+
+struct huff_stats huff_stats;
+
+// the phases this thread is in and when the top one last started running
+static __thread int phase_stack[MAX_PHASE_DEPTH];
+static __thread int phase_depth = 0;
+static __thread unsigned long long phase_mark = 0;
+
+static const char *const phase_names[NUM_PHASES] = {"read", "histogram", "tree", "codes", "model", "encode", "decode", "checksum", "write"};
+
+// function prototypes
+static unsigned long long now_ns(void);
+static void charge(int phase, unsigned long long now);
+
+void stats_enable(int on) {
+   memset(&huff_stats, 0, sizeof(huff_stats));
+   huff_stats.start = now_ns();
+   huff_stats.enabled = on;
+
+   return;
+}
+
+void stats_begin(int phase) {
+   // variable declarations
+   unsigned long long now = now_ns();
+
+   // the phase this one interrupts stops here
+   if (phase_depth > 0 && phase_depth <= MAX_PHASE_DEPTH) {
+      charge(phase_stack[phase_depth - 1], now);
+   }
+   if (phase_depth < MAX_PHASE_DEPTH) {
+      phase_stack[phase_depth] = phase;
+   }
+   phase_depth++;
+   phase_mark = now;
+   __atomic_fetch_add(&huff_stats.calls[phase], 1, __ATOMIC_RELAXED);
+
+   return;
+}
+
+void stats_end(void) {
+   // variable declarations
+   unsigned long long now = now_ns();
+
+   // statistics turned on part way through a phase have no start to end
+   if (phase_depth == 0) {
+      return;
+   }
+   if (phase_depth <= MAX_PHASE_DEPTH) {
+      charge(phase_stack[phase_depth - 1], now);
+   }
+   phase_depth--;
+   phase_mark = now;
+
+   return;
+}
+
+void stats_codes(int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS]) {
+   // variable declarations
+   unsigned long long total = 0, bits = 0;
+   double entropy = 0.0;
+   int i = 0;
+
+   for (i = 0; i < MAX_CHARS; i++) {
+      total += freq[i];
+      bits += (unsigned long long)freq[i] * lengths[i];
+   }
+   for (i = 0; i < MAX_CHARS && total > 0; i++) {
+      if (freq[i] > 0) {
+         entropy -= freq[i] * log2((double)freq[i] / total);
+      }
+   }
+
+   __atomic_fetch_add(&huff_stats.counters[STAT_CODED], total, __ATOMIC_RELAXED);
+   __atomic_fetch_add(&huff_stats.counters[STAT_CODE_BITS], bits, __ATOMIC_RELAXED);
+   __atomic_fetch_add(&huff_stats.counters[STAT_ENTROPY], (unsigned long long)(entropy * 1000.0 + 0.5), __ATOMIC_RELAXED);
+
+   return;
+}
+
+void stats_print(FILE *file, const char *program, int decompress) {
+   // variable declarations
+   unsigned long long *c = huff_stats.counters;
+   double coded = (c[STAT_CODED] > 0) ? (double)c[STAT_CODED] : 1.0;
+   double raw = (c[STAT_RAW_BYTES] > 0) ? (double)c[STAT_RAW_BYTES] : 1.0;
+   int i = 0;
+
+   // one JSON object on one line
+   fprintf(file, "{\"program\": \"%s\", \"compiled\": %s, \"seconds\": %.9f, \"phases\": {", program,
+#ifndef HUFF_NO_STATS
+         "true",
+#else
+         "false",
+#endif
+         (now_ns() - huff_stats.start) / 1e9);
+   for (i = 0; i < NUM_PHASES; i++) {
+      fprintf(file, "%s\"%s\": {\"seconds\": %.9f, \"calls\": %llu}", (i > 0) ? ", " : "", phase_names[i],
+            huff_stats.ns[i] / 1e9, huff_stats.calls[i]);
+   }
+   fprintf(file, "}, \"bytes_in\": %llu, \"bytes_out\": %llu, \"symbols\": %llu, \"blocks\": %llu, \"stored_blocks\": %llu, ",
+         decompress ? c[STAT_PACKED_BYTES] : c[STAT_RAW_BYTES], decompress ? c[STAT_RAW_BYTES] : c[STAT_PACKED_BYTES],
+         c[STAT_SYMBOLS], c[STAT_BLOCKS], c[STAT_STORED_BLOCKS]);
+
+   // the decoder never sees the character counts, so only the encoder
+   // knows the code lengths and the entropy
+   if (c[STAT_CODED] > 0) {
+      fprintf(file, "\"avg_code_len\": %.4f, \"entropy_bits_per_symbol\": %.4f, ",
+            c[STAT_CODE_BITS] / coded, c[STAT_ENTROPY] / 1000.0 / coded);
+   } else {
+      fprintf(file, "\"avg_code_len\": null, \"entropy_bits_per_symbol\": null, ");
+   }
+   fprintf(file, "\"achieved_bits_per_symbol\": %.4f, ", c[STAT_PACKED_BYTES] * 8.0 / raw);
+   fprintf(file, "\"read_calls\": %llu, \"read_bytes\": %llu, \"mapped_bytes\": %llu, \"write_calls\": %llu, \"write_bytes\": %llu}\n",
+         c[STAT_READ_CALLS], c[STAT_READ_BYTES], c[STAT_MAPPED_BYTES], c[STAT_WRITE_CALLS], c[STAT_WRITE_BYTES]);
+
+   return;
+}
+
+static unsigned long long now_ns(void) {
+   // variable declarations
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void charge(int phase, unsigned long long now) {
+   __atomic_fetch_add(&huff_stats.ns[phase], now - phase_mark, __ATOMIC_RELAXED);
+
+   return;
+}
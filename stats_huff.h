@@ -0,0 +1,152 @@
+/***************************
+ *
+ *      Programmer:     Douglas Brandt
+ *
+ *      Description:
+ *
+ *      Phase timers and counters for finding out where a run spends its
+ *      time.  The coders mark the start and end of every phase and add to
+ *      the counters through the STATS_ macros, which cost one test of a
+ *      flag while the statistics are off and compile to nothing at all
+ *      when the library is built with HUFF_NO_STATS (make STATS=0).
+ *      Phases nest, a phase started inside another one stops the clock of
+ *      the outer one, so the phase times add up to the time spent in the
+ *      coders.  The work of several threads is added together.
+ *
+ ***************************/
+
+#ifndef HUFFMAN_STATS
+#define HUFFMAN_STATS
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "tree_huff.h"
+
+// the phases of compressing and decompressing
+enum stats_phase {
+   PHASE_READ,          // read() and fread() of the input
+   PHASE_HISTOGRAM,     // counting the characters
+   PHASE_TREE,          // huffman trees and code lengths
+   PHASE_CODES,         // codes and encode/decode tables from them
+   PHASE_MODEL,         // context clustering and block splitting
+   PHASE_ENCODE,
+   PHASE_DECODE,
+   PHASE_CHECKSUM,      // block checksums of the characters
+   PHASE_WRITE,         // write() and fwrite() of the output
+   NUM_PHASES
+};
+
+enum stats_counter {
+   STAT_RAW_BYTES,      // characters going into the encoder or out of the decoder
+   STAT_PACKED_BYTES,   // their compressed size, block headers included
+   STAT_SYMBOLS,        // characters encoded or decoded
+   STAT_BLOCKS,         // stream format blocks
+   STAT_STORED_BLOCKS,  // those of them stored as they are
+   STAT_CODED,          // characters the code lengths below were counted over
+   STAT_CODE_BITS,      // bits of their codes
+   STAT_ENTROPY,        // their order-0 entropy in thousandths of a bit
+   STAT_READ_CALLS,
+   STAT_READ_BYTES,
+   STAT_MAPPED_BYTES,   // input or output going through a memory mapping instead
+   STAT_WRITE_CALLS,
+   STAT_WRITE_BYTES,
+   NUM_COUNTERS
+};
+
+struct huff_stats {
+   int enabled;
+   unsigned long long start;                 // when they were turned on
+   unsigned long long ns[NUM_PHASES];
+   unsigned long long calls[NUM_PHASES];
+   unsigned long long counters[NUM_COUNTERS];
+};
+
+extern struct huff_stats huff_stats;
+
+// function prototypes
+void stats_enable(int on);
+void stats_begin(int phase);
+void stats_end(void);
+void stats_codes(int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS]);
+void stats_print(FILE *file, const char *program, int decompress);
+
+#ifndef HUFF_NO_STATS
+#define STATS_BEGIN(phase)         do { if (huff_stats.enabled) stats_begin(phase); } while (0)
+#define STATS_END()                do { if (huff_stats.enabled) stats_end(); } while (0)
+#define STATS_ADD(counter, n)      do { if (huff_stats.enabled) __atomic_fetch_add(&huff_stats.counters[counter], (unsigned long long)(n), __ATOMIC_RELAXED); } while (0)
+#define STATS_CODES(freq, lengths) do { if (huff_stats.enabled) stats_codes(freq, lengths); } while (0)
+#else
+#define STATS_BEGIN(phase)         do { } while (0)
+#define STATS_END()                do { } while (0)
+#define STATS_ADD(counter, n)      do { } while (0)
+#define STATS_CODES(freq, lengths) do { } while (0)
+#endif
+
+// the input and output calls, timed and counted
+static inline long stats_read(int fd, void *buf, unsigned long len) {
+   // variable declarations
+   long ret = 0;
+
+   STATS_BEGIN(PHASE_READ);
+   ret = read(fd, buf, len);
+   STATS_END();
+   STATS_ADD(STAT_READ_CALLS, 1);
+   STATS_ADD(STAT_READ_BYTES, (ret > 0) ? ret : 0);
+
+   return ret;
+}
+
+static inline long stats_pread(int fd, void *buf, unsigned long len, unsigned long long offset) {
+   // variable declarations
+   long ret = 0;
+
+   STATS_BEGIN(PHASE_READ);
+   ret = pread(fd, buf, len, offset);
+   STATS_END();
+   STATS_ADD(STAT_READ_CALLS, 1);
+   STATS_ADD(STAT_READ_BYTES, (ret > 0) ? ret : 0);
+
+   return ret;
+}
+
+static inline unsigned long stats_fread(void *buf, unsigned long len, FILE *file) {
+   // variable declarations
+   unsigned long ret = 0;
+
+   STATS_BEGIN(PHASE_READ);
+   ret = fread(buf, sizeof(unsigned char), len, file);
+   STATS_END();
+   STATS_ADD(STAT_READ_CALLS, 1);
+   STATS_ADD(STAT_READ_BYTES, ret);
+
+   return ret;
+}
+
+static inline long stats_write(int fd, const void *buf, unsigned long len) {
+   // variable declarations
+   long ret = 0;
+
+   STATS_BEGIN(PHASE_WRITE);
+   ret = write(fd, buf, len);
+   STATS_END();
+   STATS_ADD(STAT_WRITE_CALLS, 1);
+   STATS_ADD(STAT_WRITE_BYTES, (ret > 0) ? ret : 0);
+
+   return ret;
+}
+
+static inline unsigned long stats_fwrite(const void *buf, unsigned long len, FILE *file) {
+   // variable declarations
+   unsigned long ret = 0;
+
+   STATS_BEGIN(PHASE_WRITE);
+   ret = fwrite(buf, sizeof(unsigned char), len, file);
+   STATS_END();
+   STATS_ADD(STAT_WRITE_CALLS, 1);
+   STATS_ADD(STAT_WRITE_BYTES, ret);
+
+   return ret;
+}
+
+#endif //HUFFMAN_STATS
@@ -5,125 +5,336 @@
  *      Description:
  *
  *      This file is the implementation code for various huffman tree
- *      related functions.
+ *      related functions.  The nodes of a tree live in one flat array (at
+ *      most 511 of them) and refer to each other by index, so a tree is
+ *      built without any allocation and goes away in one step with the
+ *      struct that holds it.
  *
  ***************************/
 
-#include <stdlib.h>  // malloc()
-#include <string.h>  // strncat(), strncpy()
-
 #include "tree_huff.h"
+#include "stats_huff.h"
+
+// function prototypes
+static int  node_before(struct huff_tree *tree, int a, int b);
+static void heap_push(struct huff_tree *tree, int heap[MAX_CHARS], int *size, int node);
+static int  heap_pop(struct huff_tree *tree, int heap[MAX_CHARS], int *size);
+static int  new_node(struct huff_tree *tree, int ch, int freq, int left, int right);
 
-struct node *generate_tree(int freq[MAX_CHARS]) {
+int generate_tree(struct huff_tree *tree, int freq[MAX_CHARS]) {
+
+   // variable declarations
+   int heap[MAX_CHARS], size = 0, count = 0, left = 0, right = 0;
 
-   int count = 0;
-   struct node *head = NULL;
+   STATS_BEGIN(PHASE_TREE);
+   tree->num_nodes = 0;
+   tree->root = -1;
 
-   // create ordered linked list
+   // the characters go in first, in character order
    for (count = 0; count < MAX_CHARS; count++) {
       if (freq[count] != 0) {
-         head = insert_ordered(head, count, freq[count], NULL, NULL, 0);
+         heap_push(tree, heap, &size, new_node(tree, count, freq[count], -1, -1));
       }
    }
 
-   if (head == NULL) {
-      return NULL;
+   if (size == 0) {
+      STATS_END();
+      return -1;
    }
 
-   // keep going until only one node remains (the root node)
-   while (head->p_next != NULL) {
-      head = insert_ordered(head, -1, head->freq + (head->p_next)->freq, head, head->p_next, 1);
-      head = (head->p_next)->p_next;
+   // keep joining the two smallest until only one node remains (the root node)
+   while (size > 1) {
+      left = heap_pop(tree, heap, &size);
+      right = heap_pop(tree, heap, &size);
+      heap_push(tree, heap, &size, new_node(tree, -1, tree->nodes[left].freq + tree->nodes[right].freq, left, right));
    }
 
-   return head;
+   tree->root = heap[0];
+   STATS_END();
+
+   return tree->root;
 }
 
-struct node *insert_ordered(struct node *old_head, int ch, int freq,
-      struct node *left, struct node *right, int tree) {
+void build_codes(struct huff_tree *tree, int node, struct code code_values[MAX_CHARS],
+      unsigned long long code, int code_len) {
 
-   // variable declarations
-   struct node *new_head;
-
-   // either first node to be inserted or at the end of the list	
-   if (old_head == NULL) {
-      // create new node
-      struct node *insert_node = (struct node *)malloc(sizeof(struct node));
-      // fill in the node's information
-      insert_node->ch = ch;
-      insert_node->freq = freq;
-      insert_node->p_left = left;
-      insert_node->p_right = right;
-      insert_node->p_next = NULL;
-      new_head = insert_node;
-   }
-   // insert node here based on freq - used for linked list building if tied, place after
-   else if ((tree == 0) && (freq < old_head->freq)) {
-      // create new node
-      struct node *insert_node = (struct node *)malloc(sizeof(struct node));
-      // fill in the node's information
-      insert_node->ch = ch;
-      insert_node->freq = freq;
-      insert_node->p_left = left;
-      insert_node->p_right = right;
-      insert_node->p_next = old_head;
-      new_head = insert_node;
-   }
-   // insert node here based on freq - used for tree building if tied, place before
-   else if ((tree == 1) && (freq <= old_head->freq)) {
-      // create new node
-      struct node *insert_node = (struct node *)malloc(sizeof(struct node));
-      // fill in the node's information
-      insert_node->ch = ch;
-      insert_node->freq = freq;
-      insert_node->p_left = left;
-      insert_node->p_right = right;
-      insert_node->p_next = old_head;
-      new_head = insert_node;
-   }
-   // process through the linked list to find the spot where the new node goes
+   // check to see if the tree is empty
+   if (node == -1) {
+      return;
+   }
+
+   // this is a character node
+   if ((tree->nodes[node].left == -1) && (tree->nodes[node].right == -1)) {
+      code_values[tree->nodes[node].ch].ch = tree->nodes[node].ch;
+      code_values[tree->nodes[node].ch].len = code_len;
+      code_values[tree->nodes[node].ch].bits = code;
+   }
+   // this is an intermediate node must go to the left and right child nodes
    else {
-      new_head = old_head;
-      new_head->p_next = insert_ordered(old_head->p_next, ch, freq, left, right, tree);
+      code_len++;
+      build_codes(tree, tree->nodes[node].left, code_values, code << 1, code_len);
+      build_codes(tree, tree->nodes[node].right, code_values, (code << 1) | 1, code_len);
    }
 
-   return new_head;
+   return;
+}
+
+char *code_to_string(const struct code *code, char str[MAX_CODE_BITS + 1]) {
+   // variable declarations
+   int i = 0;
+
+   // spell the code out as '0'/'1' characters, first bit first
+   for (i = 0; i < code->len; i++) {
+      str[i] = ((code->bits >> (code->len - 1 - i)) & 0x01) ? '1' : '0';
+   }
+   str[code->len] = '\0';
+
+   return str;
 }
 
-void build_codes(struct node *tree_head, struct code code_values[MAX_CHARS],
-      char code[MAX_PATH], int code_len) {
+void generate_code_lengths(int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS], int max_len) {
+   // variable declarations
+   struct code code_values[MAX_CHARS] = {{-1, 0, 0}};
+   struct huff_tree tree;
+   int i = 0;
+
+   // the huffman tree gives the optimal lengths
+   STATS_BEGIN(PHASE_TREE);
+   build_codes(&tree, generate_tree(&tree, freq), code_values, 0, 0);
+
+   for (i = 0; i < MAX_CHARS; i++) {
+      lengths[i] = (freq[i] != 0) ? (unsigned char)code_values[i].len : 0;
+   }
+
+   limit_code_lengths(freq, lengths, max_len);
+   STATS_END();
 
-   // check to see if the tree is NULL
-   if (tree_head == NULL) {
+   return;
+}
+
+void limit_code_lengths(int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS], int max_len) {
+   // variable declarations
+   unsigned long kraft = 0, full = 1ul << max_len;
+   int i = 0, best = -1, too_long = 0;
+
+   // clamp the long codes and add up how much of the code space is used
+   for (i = 0; i < MAX_CHARS; i++) {
+      if (lengths[i] > max_len) {
+         lengths[i] = (unsigned char)max_len;
+         too_long = 1;
+      }
+      if (freq[i] != 0 && lengths[i] != 0) {
+         kraft += full >> lengths[i];
+      }
+   }
+
+   if (!too_long) {
       return;
    }
 
-   // this is a character node
-   if ((tree_head->p_right == NULL) && (tree_head->p_left == NULL)) {
-      code_values[tree_head->ch].ch = tree_head->ch;
-      strncpy(code_values[tree_head->ch].path, code, MAX_PATH);
-      code_values[tree_head->ch].len = code_len;
+   // over subscribed, lengthen the rarest of the longest codes that can still grow
+   while (kraft > full) {
+      best = -1;
+      for (i = 0; i < MAX_CHARS; i++) {
+         if (freq[i] == 0 || lengths[i] >= max_len) {
+            continue;
+         }
+         if (best == -1 || lengths[i] > lengths[best] ||
+               (lengths[i] == lengths[best] && freq[i] < freq[best])) {
+            best = i;
+         }
+      }
+      kraft -= full >> (lengths[best] + 1);
+      lengths[best]++;
    }
-   // this is an intermediate node must go to the left and right child nodes
-   else {
-      char tmp[MAX_CHARS] = "";
-      strncpy(tmp, code, MAX_CHARS);
-      code_len++;
-      build_codes(tree_head->p_left, code_values, strncat(code, "0", 1), code_len);
-      build_codes(tree_head->p_right, code_values, strncat(tmp, "1", 1), code_len);
+
+   // hand any code space left over back to the most frequent characters
+   for (;;) {
+      best = -1;
+      for (i = 0; i < MAX_CHARS; i++) {
+         if (freq[i] == 0 || lengths[i] <= 1 || kraft + (full >> lengths[i]) > full) {
+            continue;
+         }
+         if (best == -1 || freq[i] > freq[best]) {
+            best = i;
+         }
+      }
+      if (best == -1) {
+         break;
+      }
+      kraft += full >> lengths[best];
+      lengths[best]--;
+   }
+
+   return;
+}
+
+int valid_code_lengths(int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS]) {
+   // variable declarations
+   unsigned long kraft = 0, full = 1ul << CANONICAL_MAX_LEN;
+   int i = 0, present = 0;
+
+   for (i = 0; i < MAX_CHARS; i++) {
+      if (freq[i] != 0) {
+         present++;
+         if (lengths[i] > CANONICAL_MAX_LEN) {
+            return 0;
+         }
+         if (lengths[i] != 0) {
+            kraft += full >> lengths[i];
+         }
+      }
+   }
+
+   // a lone character has an empty code, anything else must fill the code space exactly
+   if (present == 1) {
+      return kraft == 0;
    }
 
+   return kraft == full;
+}
+
+void build_canonical_codes(int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS],
+      struct code code_values[MAX_CHARS]) {
+
+   // variable declarations
+   int count[MAX_CODE_BITS + 1] = {0}, i = 0;
+   unsigned long long next[MAX_CODE_BITS + 1] = {0}, code = 0;
+
+   // count the codes of each length
+   STATS_BEGIN(PHASE_CODES);
+   for (i = 0; i < MAX_CHARS; i++) {
+      count[lengths[i]]++;
+   }
+   count[0] = 0;
+
+   // the first code of each length follows the last code of the length before it
+   for (i = 1; i <= MAX_CODE_BITS; i++) {
+      code = (code + count[i - 1]) << 1;
+      next[i] = code;
+   }
+
+   // codes of the same length are handed out in character order, a lone
+   // character keeps its empty code
+   for (i = 0; i < MAX_CHARS; i++) {
+      code_values[i].ch = (freq[i] != 0) ? i : -1;
+      code_values[i].len = lengths[i];
+      code_values[i].bits = (lengths[i] != 0) ? next[lengths[i]]++ : 0;
+   }
+   STATS_END();
+
    return;
 }
 
-void free_tree(struct node *tree_head) {
-   // recusively go through the tree freeing the nodes
-   if (tree_head != NULL) {
-      free_tree(tree_head->p_left);
-      free_tree(tree_head->p_right);
-      free(tree_head);
+int generate_code_tree(struct huff_tree *tree, struct code code_values[MAX_CHARS]) {
+   // variable declarations
+   int i = 0, j = 0, node = 0, next = 0;
+
+   // create the root
+   STATS_BEGIN(PHASE_CODES);
+   tree->num_nodes = 0;
+   tree->root = new_node(tree, -1, 0, -1, -1);
+
+   for (i = 0; i < MAX_CHARS; i++) {
+      if (code_values[i].ch == -1) {
+         continue;
+      }
+
+      // follow the code from the root, creating the missing nodes on the way
+      node = tree->root;
+      for (j = code_values[i].len - 1; j >= 0; j--) {
+         next = ((code_values[i].bits >> j) & 0x01) ? tree->nodes[node].right : tree->nodes[node].left;
+         if (next == -1) {
+            // a complete code never needs more than 2n-1 nodes
+            if (tree->num_nodes == MAX_NODES) {
+               STATS_END();
+               return -1;
+            }
+            next = new_node(tree, -1, 0, -1, -1);
+            if ((code_values[i].bits >> j) & 0x01) {
+               tree->nodes[node].right = next;
+            } else {
+               tree->nodes[node].left = next;
+            }
+         }
+         node = next;
+      }
+
+      // a lone character with an empty code is the root itself
+      tree->nodes[node].ch = code_values[i].ch;
    }
+   STATS_END();
+
+   return 0;
+}
+
+static int node_before(struct huff_tree *tree, int a, int b) {
+   // variable declarations
+   struct node *na = &tree->nodes[a], *nb = &tree->nodes[b];
+
+   if (na->freq != nb->freq) {
+      return na->freq < nb->freq;
+   }
+
+   // ties keep the order of the original sorted list: a joined node goes
+   // before every node of the same frequency (so the newest joined node
+   // comes first) and characters stay in character order
+   if (na->ch == -1 && nb->ch == -1) {
+      return a > b;
+   }
+   if (na->ch == -1 || nb->ch == -1) {
+      return na->ch == -1;
+   }
+
+   return a < b;
+}
+
+static void heap_push(struct huff_tree *tree, int heap[MAX_CHARS], int *size, int node) {
+   // variable declarations
+   int i = (*size)++, parent = 0;
+
+   // move the node up until its parent comes before it
+   while (i > 0) {
+      parent = (i - 1) / 2;
+      if (!node_before(tree, node, heap[parent])) {
+         break;
+      }
+      heap[i] = heap[parent];
+      i = parent;
+   }
+   heap[i] = node;
 
    return;
 }
 
+static int heap_pop(struct huff_tree *tree, int heap[MAX_CHARS], int *size) {
+   // variable declarations
+   int top = heap[0], last = heap[--(*size)], i = 0, child = 0;
+
+   // move the last node down from the top until both children come after it
+   while ((child = 2 * i + 1) < *size) {
+      if (child + 1 < *size && node_before(tree, heap[child + 1], heap[child])) {
+         child++;
+      }
+      if (!node_before(tree, heap[child], last)) {
+         break;
+      }
+      heap[i] = heap[child];
+      i = child;
+   }
+   heap[i] = last;
+
+   return top;
+}
+
+static int new_node(struct huff_tree *tree, int ch, int freq, int left, int right) {
+   // variable declarations
+   struct node *node = &tree->nodes[tree->num_nodes];
+
+   node->ch = ch;
+   node->freq = freq;
+   node->left = left;
+   node->right = right;
+
+   return tree->num_nodes++;
+}
@@ -8,26 +8,42 @@
 #define HUFFMAN_TREE
 
 #define MAX_CHARS 256
-#define MAX_PATH  5000
+#define MAX_NODES (2 * MAX_CHARS - 1)
+#define MAX_CODE_BITS 64      // longest code that fits in the packed bits
+#define CANONICAL_MAX_LEN 15  // code length cap for the canonical format
+
+// a coding kernel is written once with its table parameters as arguments
+// and forced inline into the callers that pass constants, so each caller
+// gets a copy with the shifts, masks and loop counts folded in
+#define KERNEL static inline __attribute__((always_inline))
 
 struct node {
-   int ch;
+   int ch;                    // -1 for a joined node
    int freq;
-   struct node *p_left;
-   struct node *p_right;
-   struct node *p_next;
+   int left;                  // index of the children in the arena, -1 if none
+   int right;
+};
+
+struct huff_tree {
+   struct node nodes[MAX_NODES];
+   int num_nodes;
+   int root;                  // -1 for an empty tree
 };
 
 struct code {
    int ch;
-   char path[MAX_PATH];
    int len;
+   unsigned long long bits;   // the path packed into the low len bits
 };
 
 // function prototypes
-struct node *generate_tree(int freq[MAX_CHARS]);
-struct node *insert_ordered(struct node *old_head, int ch, int freq, struct node *left, struct node *right, int tree);
-void build_codes(struct node *tree_head, struct code code_values[MAX_CHARS], char path[MAX_PATH], int code_len);
-void free_tree(struct node *tree_head);
+int  generate_tree(struct huff_tree *tree, int freq[MAX_CHARS]);
+void build_codes(struct huff_tree *tree, int node, struct code code_values[MAX_CHARS], unsigned long long path, int code_len);
+char *code_to_string(const struct code *code, char str[MAX_CODE_BITS + 1]);
+void generate_code_lengths(int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS], int max_len);
+void limit_code_lengths(int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS], int max_len);
+int  valid_code_lengths(int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS]);
+void build_canonical_codes(int freq[MAX_CHARS], unsigned char lengths[MAX_CHARS], struct code code_values[MAX_CHARS]);
+int  generate_code_tree(struct huff_tree *tree, struct code code_values[MAX_CHARS]);
 
 #endif //HUFFMAN_TREE